@@ -0,0 +1,727 @@
+// 压测与基准工具，各模式对应的场景见 `--mode` 的说明，结果输出到标准输出。
+// 例：./bench --mode=search --dim=128 --num=100000 --threads=1,2,4,8,16 --writer_threads=1
+#include <brpc/channel.h>
+#include <brpc/controller.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "client/client.h"
+#include "db/database.h"
+#include "index/index.h"
+#include "persistence/persistence.h"
+#include "persistence/wal.h"
+#include "util/util.h"
+
+DEFINE_string(mode, "search",
+              "Benchmark to run: search (search QPS scaling with reader threads under concurrent upserts), "
+              "upsert (upsert throughput under each WAL sync policy), "
+              "replay (startup WAL replay speed of JSON and protobuf records), "
+              "rpc (latency of the binary protobuf and HTTP/JSON interfaces of a running server), "
+              "hnsw_grow (HNSW insert latency spikes while the graph grows)");
+DEFINE_string(path, "./bench_storage/", "Scratch directory, wiped before each run");
+DEFINE_int32(dim, 128, "Dimension of the generated vectors");
+DEFINE_int32(num, 100000, "Number of vectors loaded before measuring");
+DEFINE_string(index_type, "hnsw", "Index under test: flat, hnsw, ivf");
+DEFINE_string(threads, "1,2,4,8,16", "Comma separated list of client thread counts to measure");
+DEFINE_int32(writer_threads, 1, "Threads upserting concurrently while the search benchmark runs");
+DEFINE_int32(duration_s, 10, "Seconds each measurement runs");
+DEFINE_int32(k, 10, "Top k of each search");
+DEFINE_string(wal_sync_policies, "none,batch,per-request", "Comma separated list of WAL sync policies to measure");
+DEFINE_int32(wal_sync_interval_ms, 10, "Group commit interval of the batch WAL sync policy");
+DEFINE_int32(batch_size, 1, "Vectors per upsert call, more than 1 uses upsert_batch");
+DEFINE_string(wal_versions, "json,pb", "Comma separated list of WAL record formats to replay: json, pb");
+DEFINE_int32(replay_threads, 0, "Number of threads decoding WAL records on startup, 0 means the number of cores");
+DEFINE_string(server, "127.0.0.1:7123", "Address of the running server measured by the rpc mode");
+DEFINE_int32(hnsw_initial_capacity, 1000, "Initial capacity of the growing HNSW index in the hnsw_grow mode");
+DEFINE_double(hnsw_growth_factor, 2.0, "Growth factor of the HNSW index in the hnsw_grow mode");
+DEFINE_string(protocols, "pb,http", "Comma separated list of interfaces to measure: pb (baidu_std), http (JSON)");
+
+namespace vdb {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int LOAD_BATCH_SIZE = 1000;
+
+// 与 database.cc 中 WAL 记录体的格式版本一致
+const uint8_t WAL_VERSION_JSON = 1;
+const uint8_t WAL_VERSION_PB = 2;
+const char WAL_TYPE_UPSERT = 1;
+
+/************************************************************************/
+/* Helpers */
+/************************************************************************/
+std::vector<std::string> SplitList(const std::string& str) {
+  std::vector<std::string> items;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+std::vector<int> ParseThreads(const std::string& str) {
+  std::vector<int> threads;
+  for (const auto& item : SplitList(str)) {
+    if (std::stoi(item) > 0) {
+      threads.push_back(std::stoi(item));
+    }
+  }
+  return threads;
+}
+
+bool StringToIndexType(const std::string& str, service::IndexType* index_type) {
+  if (str == "flat") {
+    *index_type = service::IndexType::IT_FLAT;
+  } else if (str == "hnsw") {
+    *index_type = service::IndexType::IT_HNSW;
+  } else if (str == "ivf") {
+    *index_type = service::IndexType::IT_IVF;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::vector<float> RandomVectors(size_t n, int dim, uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> dist(0, 1);
+  std::vector<float> data(n * dim);
+  for (auto& x : data) {
+    x = dist(gen);
+  }
+  return data;
+}
+
+// 清空并重建 `FLAGS_path/name/`
+std::string ScratchDir(const std::string& name) {
+  std::filesystem::path path = std::filesystem::path(FLAGS_path) / name;
+  std::filesystem::remove_all(path);
+  std::filesystem::create_directories(path);
+  return path.string() + "/";
+}
+
+int64_t MicrosSince(Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+// 延迟分位数，单位微秒
+struct LatencyStats {
+  int64_t p50{0};
+  int64_t p99{0};
+  int64_t max{0};
+};
+
+LatencyStats ComputeLatency(std::vector<int64_t>* latencies) {
+  LatencyStats stats;
+  if (latencies->empty()) {
+    return stats;
+  }
+  std::sort(latencies->begin(), latencies->end());
+  auto at = [&](double q) { return (*latencies)[std::min(latencies->size() - 1, (size_t)(latencies->size() * q))]; };
+  stats.p50 = at(0.5);
+  stats.p99 = at(0.99);
+  stats.max = latencies->back();
+  return stats;
+}
+
+// 合并各线程记录的延迟
+std::vector<int64_t> MergeLatencies(const std::vector<std::vector<int64_t>>& latencies) {
+  std::vector<int64_t> all;
+  for (const auto& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  return all;
+}
+
+std::string ToString(const LatencyStats& stats) {
+  std::ostringstream os;
+  os << "p50_us=" << stats.p50 << " p99_us=" << stats.p99 << " max_us=" << stats.max;
+  return os.str();
+}
+
+double PerSecond(size_t count, int64_t micros) { return micros > 0 ? count * 1e6 / micros : 0; }
+
+// `req` 需在写入完成前保持有效
+Database::UpsertOptions ToUpsertOptions(const service::UpsertRequest& req) {
+  Database::UpsertOptions opts;
+  opts.id = req.id();
+  opts.index_type = (service::IndexType)req.index_type();
+  opts.data = req.vector().data();
+  opts.size = req.vector_size();
+  opts.scalar_data = req.SerializeAsString();
+  opts.field = &req.fields();
+  opts.typed_field = &req.typed_fields();
+  return opts;
+}
+
+service::UpsertRequest MakeUpsertRequest(int64_t id, service::IndexType index_type, const float* data, int dim) {
+  service::UpsertRequest req;
+  req.set_id(id);
+  req.set_index_type(index_type);
+  req.mutable_vector()->Add(data, data + dim);
+  (*req.mutable_fields())["tenant"] = id % 16;
+  return req;
+}
+
+Database::InitOptions DefaultInitOptions(const std::string& path) {
+  Database::InitOptions opts;
+  opts.persistence_path = path;
+  opts.dim = FLAGS_dim;
+  opts.num_data = FLAGS_num;
+  opts.wal_sync_policy = WALWriter::SP_NONE;
+  return opts;
+}
+
+// 按批写入 id 为 [1, n] 的向量
+bool LoadVectors(Database* db, service::IndexType index_type, const std::vector<float>& data, size_t n) {
+  std::vector<service::UpsertRequest> reqs;
+  std::vector<Database::UpsertOptions> opts;
+  for (size_t begin = 0; begin < n; begin += LOAD_BATCH_SIZE) {
+    size_t end = std::min(n, begin + LOAD_BATCH_SIZE);
+    reqs.clear();
+    opts.clear();
+    for (size_t i = begin; i < end; ++i) {
+      reqs.push_back(MakeUpsertRequest(i + 1, index_type, data.data() + i * FLAGS_dim, FLAGS_dim));
+    }
+    for (const auto& req : reqs) {
+      opts.push_back(ToUpsertOptions(req));
+    }
+    if (!db->UpsertBatch(opts)) {
+      LOG(ERROR) << "Failed to load vectors, begin=" << begin << ".";
+      return false;
+    }
+  }
+  return true;
+}
+
+/************************************************************************/
+/* search: 读并发的扩展性 */
+/************************************************************************/
+// 每轮 `threads` 个线程持续搜索 `duration_s` 秒，同时 `writer_threads` 个线程持续覆盖写已有 id，
+// 输出 QPS 相对单线程的加速比，以及写入期间的搜索延迟
+bool RunSearch() {
+  service::IndexType index_type;
+  if (!StringToIndexType(FLAGS_index_type, &index_type)) {
+    LOG(ERROR) << "Invalid index_type:" << FLAGS_index_type << ".";
+    return false;
+  }
+  Database db;
+  if (!db.Init(DefaultInitOptions(ScratchDir("search")))) {
+    return false;
+  }
+  auto data = RandomVectors(FLAGS_num, FLAGS_dim, 1);
+  if (!LoadVectors(&db, index_type, data, FLAGS_num)) {
+    return false;
+  }
+  auto queries = RandomVectors(1024, FLAGS_dim, 2);
+
+  double base_qps = 0;
+  std::cout << "mode=search index_type=" << FLAGS_index_type << " num=" << FLAGS_num << " dim=" << FLAGS_dim
+            << " writer_threads=" << FLAGS_writer_threads << " cores=" << std::thread::hardware_concurrency()
+            << std::endl;
+  for (int num_threads : ParseThreads(FLAGS_threads)) {
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> writes{0};
+    std::atomic<bool> ok{true};
+    std::vector<std::vector<int64_t>> latencies(num_threads);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&, t] {
+        Database::SearchOptions opts;
+        opts.index_type = index_type;
+        opts.size = FLAGS_dim;
+        opts.k = FLAGS_k;
+        Database::SearchResult res;
+        for (size_t i = t; !stop; ++i) {
+          opts.query = queries.data() + (i % 1024) * FLAGS_dim;
+          auto begin = Clock::now();
+          if (!db.Search(opts, &res)) {
+            ok = false;
+            return;
+          }
+          latencies[t].push_back(MicrosSince(begin));
+        }
+      });
+    }
+    for (int t = 0; t < FLAGS_writer_threads; ++t) {
+      threads.emplace_back([&, t] {
+        std::mt19937 gen(t);
+        std::uniform_int_distribution<int64_t> id_dist(1, FLAGS_num);
+        while (!stop) {
+          int64_t id = id_dist(gen);
+          auto req = MakeUpsertRequest(id, index_type, data.data() + (id - 1) * FLAGS_dim, FLAGS_dim);
+          if (!db.Upsert(ToUpsertOptions(req))) {
+            ok = false;
+            return;
+          }
+          ++writes;
+        }
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(FLAGS_duration_s));
+    stop = true;
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    int64_t elapsed = MicrosSince(start);
+    if (!ok) {
+      LOG(ERROR) << "Failed to run search benchmark, threads=" << num_threads << ".";
+      return false;
+    }
+
+    auto all = MergeLatencies(latencies);
+    double qps = PerSecond(all.size(), elapsed);
+    if (base_qps == 0) {
+      base_qps = qps;
+    }
+    std::cout << "threads=" << num_threads << " qps=" << std::fixed << std::setprecision(0) << qps
+              << " speedup=" << std::setprecision(2) << (base_qps > 0 ? qps / base_qps : 0)
+              << " writes_per_sec=" << std::setprecision(0) << PerSecond(writes, elapsed) << " "
+              << ToString(ComputeLatency(&all)) << std::endl;
+  }
+  return true;
+}
+
+/************************************************************************/
+/* upsert: 各 WAL 刷盘策略下的写入吞吐 */
+/************************************************************************/
+// 每种策略与线程数使用全新的目录，`threads` 个线程持续写入新 id `duration_s` 秒；
+// `batch_size` 大于 1 时走 `UpsertBatch`，延迟为每次调用的耗时
+bool RunUpsert() {
+  service::IndexType index_type;
+  if (!StringToIndexType(FLAGS_index_type, &index_type)) {
+    LOG(ERROR) << "Invalid index_type:" << FLAGS_index_type << ".";
+    return false;
+  }
+  const size_t num_vectors = 1024;
+  auto data = RandomVectors(num_vectors, FLAGS_dim, 1);
+  size_t batch_size = std::max(FLAGS_batch_size, 1);
+
+  std::cout << "mode=upsert index_type=" << FLAGS_index_type << " dim=" << FLAGS_dim << " batch_size=" << batch_size
+            << " wal_sync_interval_ms=" << FLAGS_wal_sync_interval_ms << std::endl;
+  for (const auto& policy_name : SplitList(FLAGS_wal_sync_policies)) {
+    WALWriter::SyncPolicy policy;
+    if (!StringToSyncPolicy(policy_name, &policy)) {
+      LOG(ERROR) << "Invalid wal_sync_policy:" << policy_name << ".";
+      return false;
+    }
+    for (int num_threads : ParseThreads(FLAGS_threads)) {
+      Database db;
+      auto init_opts = DefaultInitOptions(ScratchDir("upsert"));
+      init_opts.wal_sync_policy = policy;
+      init_opts.wal_sync_interval_ms = FLAGS_wal_sync_interval_ms;
+      if (!db.Init(init_opts)) {
+        return false;
+      }
+
+      std::atomic<bool> stop{false};
+      std::atomic<bool> ok{true};
+      std::atomic<int64_t> next_id{1};
+      std::vector<std::vector<int64_t>> latencies(num_threads);
+      std::vector<std::thread> threads;
+      auto start = Clock::now();
+      for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+          std::vector<service::UpsertRequest> reqs(batch_size);
+          std::vector<Database::UpsertOptions> opts(batch_size);
+          while (!stop) {
+            int64_t first_id = next_id.fetch_add(batch_size);
+            for (size_t i = 0; i < batch_size; ++i) {
+              int64_t id = first_id + i;
+              reqs[i] = MakeUpsertRequest(id, index_type, data.data() + (id % num_vectors) * FLAGS_dim, FLAGS_dim);
+              opts[i] = ToUpsertOptions(reqs[i]);
+            }
+            auto begin = Clock::now();
+            if (!(batch_size > 1 ? db.UpsertBatch(opts) : db.Upsert(opts[0]))) {
+              ok = false;
+              return;
+            }
+            latencies[t].push_back(MicrosSince(begin));
+          }
+        });
+      }
+      std::this_thread::sleep_for(std::chrono::seconds(FLAGS_duration_s));
+      stop = true;
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      int64_t elapsed = MicrosSince(start);
+      if (!ok) {
+        LOG(ERROR) << "Failed to run upsert benchmark, policy=" << policy_name << ",threads=" << num_threads << ".";
+        return false;
+      }
+
+      auto all = MergeLatencies(latencies);
+      std::cout << "policy=" << policy_name << " threads=" << num_threads << " upserts_per_sec=" << std::fixed
+                << std::setprecision(0) << PerSecond(all.size() * batch_size, elapsed)
+                << " calls_per_sec=" << PerSecond(all.size(), elapsed) << " " << ToString(ComputeLatency(&all))
+                << std::endl;
+    }
+  }
+  return true;
+}
+
+/************************************************************************/
+/* replay: 启动时的 WAL 回放速度 */
+/************************************************************************/
+// 直接通过 `Persistence` 以指定格式写入 `num` 条记录，再计时 `Database::Reload`
+bool WriteWAL(const std::string& path, uint8_t version, service::IndexType index_type, size_t n) {
+  Persistence persistence;
+  Persistence::InitOptions opts;
+  opts.path = path;
+  opts.version = version;
+  opts.wal_sync_policy = WALWriter::SP_NONE;
+  if (!persistence.Init(opts)) {
+    return false;
+  }
+  const size_t num_vectors = 1024;
+  auto data = RandomVectors(num_vectors, FLAGS_dim, 1);
+  std::vector<std::string> records;
+  std::vector<std::string_view> datas;
+  uint64_t seq = 0;
+  for (size_t begin = 0; begin < n; begin += LOAD_BATCH_SIZE) {
+    size_t end = std::min(n, begin + LOAD_BATCH_SIZE);
+    records.clear();
+    datas.clear();
+    for (size_t i = begin; i < end; ++i) {
+      auto req = MakeUpsertRequest(i + 1, index_type, data.data() + (i % num_vectors) * FLAGS_dim, FLAGS_dim);
+      records.push_back(version == WAL_VERSION_JSON ? PbToJsonStr(req) : req.SerializeAsString());
+    }
+    for (const auto& record : records) {
+      datas.emplace_back(record);
+    }
+    if (!persistence.AppendWALLogBatch(WAL_TYPE_UPSERT, datas, &seq)) {
+      return false;
+    }
+  }
+  return persistence.SyncWALLog(seq);
+}
+
+uint64_t DirectorySize(const std::string& path) {
+  uint64_t size = 0;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+    if (entry.is_regular_file()) {
+      size += entry.file_size();
+    }
+  }
+  return size;
+}
+
+bool RunReplay() {
+  service::IndexType index_type;
+  if (!StringToIndexType(FLAGS_index_type, &index_type)) {
+    LOG(ERROR) << "Invalid index_type:" << FLAGS_index_type << ".";
+    return false;
+  }
+  std::cout << "mode=replay index_type=" << FLAGS_index_type << " num=" << FLAGS_num << " dim=" << FLAGS_dim
+            << " replay_threads=" << FLAGS_replay_threads << std::endl;
+  for (const auto& name : SplitList(FLAGS_wal_versions)) {
+    uint8_t version = 0;
+    if (name == "json") {
+      version = WAL_VERSION_JSON;
+    } else if (name == "pb") {
+      version = WAL_VERSION_PB;
+    } else {
+      LOG(ERROR) << "Invalid wal_version:" << name << ".";
+      return false;
+    }
+    auto path = ScratchDir("replay");
+    if (!WriteWAL(path, version, index_type, FLAGS_num)) {
+      LOG(ERROR) << "Failed to write WAL, wal_version=" << name << ".";
+      return false;
+    }
+    uint64_t wal_bytes = DirectorySize(path + "wal/");
+
+    Database db;
+    auto init_opts = DefaultInitOptions(path);
+    init_opts.replay_threads = FLAGS_replay_threads;
+    if (!db.Init(init_opts)) {
+      return false;
+    }
+    auto start = Clock::now();
+    if (!db.Reload()) {
+      LOG(ERROR) << "Failed to reload, wal_version=" << name << ".";
+      return false;
+    }
+    int64_t elapsed = MicrosSince(start);
+    std::cout << "wal_version=" << name << " records=" << FLAGS_num << " wal_mb=" << std::fixed
+              << std::setprecision(1) << wal_bytes / 1048576.0 << " reload_s=" << std::setprecision(2)
+              << elapsed / 1e6 << " records_per_sec=" << std::setprecision(0) << PerSecond(FLAGS_num, elapsed)
+              << std::endl;
+  }
+  return true;
+}
+
+/************************************************************************/
+/* rpc: 二进制 protobuf 与 HTTP/JSON 接口的延迟 */
+/************************************************************************/
+// 与 test.sh 中 curl 的请求一致，计时包含客户端的 JSON 编解码
+class HttpClient {
+ private:
+  brpc::Channel channel_;
+
+ public:
+  bool Init(const std::string& server_addr) {
+    brpc::ChannelOptions options;
+    options.protocol = "http";
+    options.timeout_ms = 1000;
+    if (channel_.Init(server_addr.c_str(), &options) != 0) {
+      LOG(ERROR) << "Failed to init http channel, server_addr=" << server_addr << ".";
+      return false;
+    }
+    return true;
+  }
+
+  template <typename Request, typename Response>
+  bool Call(const std::string& path, const Request& req, Response* resp) {
+    brpc::Controller cntl;
+    cntl.http_request().uri() = "/VdbService/http/" + path;
+    cntl.http_request().set_method(brpc::HTTP_METHOD_POST);
+    cntl.request_attachment().append(PbToJsonStr(req));
+    channel_.CallMethod(nullptr, &cntl, nullptr, nullptr, nullptr);
+    if (cntl.Failed()) {
+      LOG(WARNING) << "Failed to call " << path << ", error=" << cntl.ErrorText() << ".";
+      return false;
+    }
+    return JsonStrToPb(cntl.response_attachment().to_string(), resp).ok();
+  }
+};
+
+// `num_threads` 个线程循环调用 `call(i)` `duration_s` 秒，记录每次调用的延迟
+template <typename Call>
+bool MeasureCalls(int num_threads, const Call& call, std::vector<int64_t>* all, int64_t* elapsed) {
+  std::atomic<bool> stop{false};
+  std::atomic<bool> ok{true};
+  std::vector<std::vector<int64_t>> latencies(num_threads);
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t] {
+      for (size_t i = t; !stop; i += num_threads) {
+        auto begin = Clock::now();
+        if (!call(i)) {
+          ok = false;
+          return;
+        }
+        latencies[t].push_back(MicrosSince(begin));
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(FLAGS_duration_s));
+  stop = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  *elapsed = MicrosSince(start);
+  *all = MergeLatencies(latencies);
+  return ok;
+}
+
+// 先经二进制接口写入 id 为 [1, num] 的向量，再对每种接口与线程数分别测搜索和覆盖写的延迟。
+// 请求在计时前构造好，两种接口收发的是同一批请求
+bool RunRpc() {
+  service::IndexType index_type;
+  if (!StringToIndexType(FLAGS_index_type, &index_type)) {
+    LOG(ERROR) << "Invalid index_type:" << FLAGS_index_type << ".";
+    return false;
+  }
+  if (FLAGS_num <= 0) {
+    LOG(ERROR) << "Invalid num:" << FLAGS_num << ".";
+    return false;
+  }
+  VdbClient client;
+  VdbClient::InitOptions client_opts;
+  client_opts.server_addr = FLAGS_server;
+  HttpClient http;
+  if (!client.Init(client_opts) || !http.Init(FLAGS_server)) {
+    return false;
+  }
+
+  auto data = RandomVectors(FLAGS_num, FLAGS_dim, 1);
+  for (int begin = 0; begin < FLAGS_num; begin += LOAD_BATCH_SIZE) {
+    service::UpsertBatchRequest req;
+    for (int i = begin; i < std::min(FLAGS_num, begin + LOAD_BATCH_SIZE); ++i) {
+      *req.add_items() = MakeUpsertRequest(i + 1, index_type, data.data() + (size_t)i * FLAGS_dim, FLAGS_dim);
+    }
+    service::EmptyResponse resp;
+    if (!client.UpsertBatch(req, &resp) || resp.ret_code() != 200) {
+      LOG(ERROR) << "Failed to load vectors, begin=" << begin << ",msg=" << resp.msg() << ".";
+      return false;
+    }
+  }
+  auto queries = RandomVectors(1024, FLAGS_dim, 2);
+  std::vector<service::SearchRequest> search_reqs(1024);
+  for (size_t i = 0; i < search_reqs.size(); ++i) {
+    search_reqs[i].set_index_type(index_type);
+    search_reqs[i].set_k(FLAGS_k);
+    search_reqs[i].mutable_vector()->Add(queries.data() + i * FLAGS_dim, queries.data() + (i + 1) * FLAGS_dim);
+  }
+  std::vector<service::UpsertRequest> upsert_reqs;
+  for (int i = 0; i < std::min(FLAGS_num, 1024); ++i) {
+    upsert_reqs.push_back(MakeUpsertRequest(i + 1, index_type, data.data() + (size_t)i * FLAGS_dim, FLAGS_dim));
+  }
+
+  std::cout << "mode=rpc server=" << FLAGS_server << " index_type=" << FLAGS_index_type << " num=" << FLAGS_num
+            << " dim=" << FLAGS_dim << " k=" << FLAGS_k << std::endl;
+  for (const auto& protocol : SplitList(FLAGS_protocols)) {
+    if (protocol != "pb" && protocol != "http") {
+      LOG(ERROR) << "Invalid protocol:" << protocol << ".";
+      return false;
+    }
+    bool use_http = protocol == "http";
+    auto search = [&](size_t i) {
+      const auto& req = search_reqs[i % search_reqs.size()];
+      service::SearchResponse resp;
+      bool ok = use_http ? http.Call("search", req, &resp) : client.Search(req, &resp);
+      return ok && resp.ret_code() == 200;
+    };
+    auto upsert = [&](size_t i) {
+      const auto& req = upsert_reqs[i % upsert_reqs.size()];
+      service::EmptyResponse resp;
+      bool ok = use_http ? http.Call("upsert", req, &resp) : client.Upsert(req, &resp);
+      return ok && resp.ret_code() == 200;
+    };
+    for (int num_threads : ParseThreads(FLAGS_threads)) {
+      for (const std::string method : {"search", "upsert"}) {
+        std::vector<int64_t> all;
+        int64_t elapsed = 0;
+        bool ok = method == "search" ? MeasureCalls(num_threads, search, &all, &elapsed)
+                                     : MeasureCalls(num_threads, upsert, &all, &elapsed);
+        if (!ok) {
+          LOG(ERROR) << "Failed to run rpc benchmark, protocol=" << protocol << ",method=" << method
+                     << ",threads=" << num_threads << ".";
+          return false;
+        }
+        std::cout << "protocol=" << protocol << " method=" << method << " threads=" << num_threads
+                  << " qps=" << std::fixed << std::setprecision(0) << PerSecond(all.size(), elapsed) << " "
+                  << ToString(ComputeLatency(&all)) << std::endl;
+      }
+    }
+  }
+  return true;
+}
+
+/************************************************************************/
+/* hnsw_grow: HNSW 扩容时的插入延迟 */
+/************************************************************************/
+// 与 `HNSWLibIndex::Reserve` 的规则相同（不含墓碑复用），返回触发扩容的插入序号及扩容前后的容量
+struct ResizePoint {
+  size_t pos{0};
+  size_t capacity{0};
+  size_t new_capacity{0};
+};
+
+std::vector<ResizePoint> PredictResizes(size_t n, size_t capacity, double growth_factor) {
+  growth_factor = std::max(growth_factor, 1.1);
+  capacity = std::max<size_t>(capacity, 1);
+  std::vector<ResizePoint> points;
+  for (size_t i = 0; i < n; ++i) {
+    if (i + 1 > capacity) {
+      size_t new_capacity = std::max(i + 1, (size_t)(capacity * growth_factor));
+      points.push_back({i, capacity, new_capacity});
+      capacity = new_capacity;
+    }
+  }
+  return points;
+}
+
+// 单线程逐条插入 `num` 个向量，分别以 `hnsw_initial_capacity` 起步扩容和一开始就预留 `num` 的容量，
+// 输出整体延迟、各次扩容所在插入的延迟，以及其余插入的延迟
+bool RunHNSWGrow() {
+  if (FLAGS_num <= 0) {
+    LOG(ERROR) << "Invalid num:" << FLAGS_num << ".";
+    return false;
+  }
+  auto data = RandomVectors(FLAGS_num, FLAGS_dim, 1);
+  std::cout << "mode=hnsw_grow num=" << FLAGS_num << " dim=" << FLAGS_dim
+            << " initial_capacity=" << FLAGS_hnsw_initial_capacity << " growth_factor=" << FLAGS_hnsw_growth_factor
+            << std::endl;
+  for (bool grow : {true, false}) {
+    HNSWOptions opts;
+    opts.num_data = grow ? FLAGS_hnsw_initial_capacity : FLAGS_num;
+    opts.growth_factor = FLAGS_hnsw_growth_factor;
+    opts.compact_ratio = 0;
+    auto index = NewHNSWLibIndex(FLAGS_dim, MetricType::L2, opts);
+
+    std::vector<int64_t> latencies(FLAGS_num);
+    auto start = Clock::now();
+    for (int i = 0; i < FLAGS_num; ++i) {
+      Index::InsertOptions insert_opts;
+      insert_opts.data = data.data() + (size_t)i * FLAGS_dim;
+      insert_opts.label = i;
+      auto begin = Clock::now();
+      index->Insert(insert_opts);
+      latencies[i] = MicrosSince(begin);
+    }
+    int64_t elapsed = MicrosSince(start);
+
+    auto resizes = PredictResizes(FLAGS_num, opts.num_data, opts.growth_factor);
+    std::vector<bool> is_resize(FLAGS_num);
+    std::ostringstream details;
+    for (const auto& point : resizes) {
+      details << "  resize pos=" << point.pos << " capacity=" << point.capacity
+              << " new_capacity=" << point.new_capacity << " latency_us=" << latencies[point.pos] << "\n";
+      is_resize[point.pos] = true;
+    }
+    std::vector<int64_t> others;
+    for (int i = 0; i < FLAGS_num; ++i) {
+      if (!is_resize[i]) {
+        others.push_back(latencies[i]);
+      }
+    }
+    std::cout << "capacity=" << (grow ? "growing" : "presized") << " inserts_per_sec=" << std::fixed
+              << std::setprecision(0) << PerSecond(FLAGS_num, elapsed) << " resizes=" << resizes.size() << " "
+              << ToString(ComputeLatency(&latencies)) << " without_resize: " << ToString(ComputeLatency(&others))
+              << std::endl
+              << details.str();
+  }
+  return true;
+}
+
+}  // namespace
+
+}  // namespace vdb
+
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  bool ok = false;
+  if (FLAGS_mode == "search") {
+    ok = vdb::RunSearch();
+  } else if (FLAGS_mode == "upsert") {
+    ok = vdb::RunUpsert();
+  } else if (FLAGS_mode == "replay") {
+    ok = vdb::RunReplay();
+  } else if (FLAGS_mode == "rpc") {
+    ok = vdb::RunRpc();
+  } else if (FLAGS_mode == "hnsw_grow") {
+    ok = vdb::RunHNSWGrow();
+  } else {
+    LOG(ERROR) << "Invalid mode:" << FLAGS_mode << ".";
+  }
+
+  google::ShutDownCommandLineFlags();
+  google::ShutdownGoogleLogging();
+  return ok ? 0 : -1;
+}
@@ -1,9 +1,18 @@
 curl -X POST -d '{"vector": [0.8], "id":10, "index_type":1, "fields": {"aaa": 19}}' http://localhost:7123/VdbService/http/upsert
 curl -X POST -d '{"vector": [0.8], "id":10, "index_type":1, "fields": {"aaa": 20}}' http://localhost:7123/VdbService/http/upsert
+curl -X POST -d '{"vector": [0.6], "id":15, "index_type":1, "typed_fields": {"city": {"string_value": "beijing"}, "price": {"float_value": 9.5}, "online": {"bool_value": true}}}' http://localhost:7123/VdbService/http/upsert
 curl -X POST -d '{"vector": [0.5], "k":2, "index_type":1, "condition": {"field":"aaa", "op":"=", "value": 19 }}' http://localhost:7123/VdbService/http/search
 curl -X POST -d '{"vector": [0.5], "k":2, "index_type":1, "condition": {"field":"aaa", "op":"!=", "value": 19 }}' http://localhost:7123/VdbService/http/search
+curl -X POST -d '{"vector": [0.5], "k":2, "index_type":1, "condition": {"field":"aaa", "op":"between", "value": 18, "upper": 20 }}' http://localhost:7123/VdbService/http/search
+curl -X POST -d '{"vector": [0.5], "k":2, "index_type":1, "filter": {"op":"and", "children": [{"condition": {"field":"aaa", "op":"in", "values": [18, 19]}}, {"op":"not", "children": [{"condition": {"field":"bbb", "op":"=", "value": 11}}]}]}}' http://localhost:7123/VdbService/http/search
+curl -X POST -d '{"vector": [0.5], "k":2, "index_type":1, "filter": {"op":"and", "children": [{"condition": {"field":"city", "op":"=", "typed_value": {"string_value": "beijing"}}}, {"condition": {"field":"price", "op":"between", "typed_value": {"float_value": 5.0}, "typed_upper": {"float_value": 10.0}}}]}}' http://localhost:7123/VdbService/http/search
 curl -X POST -d '{"id":10}' http://localhost:7123/VdbService/http/query
 curl -X POST -d '{"vector": [0.3], "id":11, "index_type":2, "fields": {"bbb": 11}}' http://localhost:7123/VdbService/http/upsert
 curl -X POST -d '{"id":11}' http://localhost:7123/VdbService/http/query
+curl -X POST -d '{"items": [{"vector": [0.1], "id":12, "index_type":1, "fields": {"aaa": 19}}, {"vector": [0.2], "id":13, "index_type":2, "fields": {"bbb": 11}}]}' http://localhost:7123/VdbService/http/upsert_batch
 curl -X POST -d '{"vector": [0.5], "k":2, "index_type":2, "condition": {"field":"bbb", "op":"=", "value": 11 }}' http://localhost:7123/VdbService/http/search
+curl -X POST -d '{"vector": [0.5, 0.1], "k":2, "index_type":2}' http://localhost:7123/VdbService/http/search
+curl -X POST -d '{"vector": [0.5], "k":2, "index_type":2, "ef_search":100, "adaptive_ef":true, "condition": {"field":"bbb", "op":"=", "value": 11 }}' http://localhost:7123/VdbService/http/search
+curl -X POST -d '{"vector": [0.4], "id":14, "index_type":3}' http://localhost:7123/VdbService/http/upsert
+curl -X POST -d '{"vector": [0.5], "k":2, "index_type":3, "nprobe":8}' http://localhost:7123/VdbService/http/search
 curl -X POST -d '{}' http://localhost:7123/VdbService/http/snapshot
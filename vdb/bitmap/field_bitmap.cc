@@ -1,64 +1,568 @@
 #include "bitmap/field_bitmap.h"
 #include <glog/logging.h>
 #include <stddef.h>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <limits>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <utility>
 
 namespace vdb {
 
+namespace {
+
+roaring_bitmap_ptr NewBitmap(roaring_bitmap_t* bitmap = roaring_bitmap_create()) {
+  return roaring_bitmap_ptr(bitmap, roaring_bitmap_free);
+}
+
+inline uint64_t EncodeValue(int64_t value) { return (uint64_t)value ^ (1ULL << 63); }
+
+// 带类型的快照以该值开头；旧格式开头是记录长度，不会是该值
+const uint64_t SCHEMA_MAGIC = std::numeric_limits<uint64_t>::max();
+
+// 负数翻转除符号位外的各位，使 int64 的大小顺序与 double 一致；-0.0 与 0.0 编码相同
+int64_t EncodeFloat(double value) {
+  if (value == 0) {
+    value = 0;
+  }
+  int64_t bits = 0;
+  std::memcpy(&bits, &value, 8);
+  return bits < 0 ? bits ^ std::numeric_limits<int64_t>::max() : bits;
+}
+
+bool ToFieldType(const service::FieldValue& value, FieldBitmap::FieldType* type) {
+  switch (value.value_case()) {
+    case service::FieldValue::kIntValue:
+      *type = FieldBitmap::FieldType::INT64;
+      return true;
+    case service::FieldValue::kFloatValue:
+      *type = FieldBitmap::FieldType::FLOAT;
+      return true;
+    case service::FieldValue::kStringValue:
+      *type = FieldBitmap::FieldType::STRING;
+      return true;
+    case service::FieldValue::kBoolValue:
+      *type = FieldBitmap::FieldType::BOOL;
+      return true;
+    default:
+      return false;
+  }
+}
+
+service::FieldValue IntFieldValue(int64_t value) {
+  service::FieldValue field_value;
+  field_value.set_int_value(value);
+  return field_value;
+}
+
+// 写时复制：需持有写锁。读方只在读锁下获取新的引用，因此此时引用计数只减不增
+// 取反后的比较；`BETWEEN` 没有对应的单个比较，原样返回
+FieldBitmap::Operation NegateOperation(FieldBitmap::Operation op) {
+  switch (op) {
+    case FieldBitmap::Operation::EQUAL:
+      return FieldBitmap::Operation::NOT_EQUAL;
+    case FieldBitmap::Operation::NOT_EQUAL:
+      return FieldBitmap::Operation::EQUAL;
+    case FieldBitmap::Operation::LESS:
+      return FieldBitmap::Operation::GREATER_EQUAL;
+    case FieldBitmap::Operation::LESS_EQUAL:
+      return FieldBitmap::Operation::GREATER;
+    case FieldBitmap::Operation::GREATER:
+      return FieldBitmap::Operation::LESS_EQUAL;
+    case FieldBitmap::Operation::GREATER_EQUAL:
+      return FieldBitmap::Operation::LESS;
+    default:
+      return op;
+  }
+}
+
+roaring_bitmap_t* MutableBitmap(roaring_bitmap_ptr* bitmap) {
+  if (bitmap->use_count() > 1) {
+    *bitmap = NewBitmap(roaring_bitmap_copy(bitmap->get()));
+  }
+  return bitmap->get();
+}
+
+}  // namespace
+
+/************************************************************************/
+/* BitSlicedBitmap */
+/************************************************************************/
+BitSlicedBitmap::BitSlicedBitmap() : exists_(NewBitmap()) {
+  slices_.reserve(BIT_WIDTH);
+  for (int i = 0; i < BIT_WIDTH; ++i) {
+    slices_.push_back(NewBitmap());
+  }
+}
+
+void BitSlicedBitmap::Add(uint32_t id, int64_t value) {
+  uint64_t bits = EncodeValue(value);
+  roaring_bitmap_add(MutableBitmap(&exists_), id);
+  for (int i = 0; i < BIT_WIDTH; ++i) {
+    if ((bits >> i) & 1) {
+      roaring_bitmap_add(slices_[i].get(), id);
+    }
+  }
+}
+
+void BitSlicedBitmap::Remove(uint32_t id) {
+  if (!roaring_bitmap_contains(exists_.get(), id)) {
+    return;
+  }
+  roaring_bitmap_remove(MutableBitmap(&exists_), id);
+  for (int i = 0; i < BIT_WIDTH; ++i) {
+    roaring_bitmap_remove(slices_[i].get(), id);
+  }
+}
+
+std::optional<int64_t> BitSlicedBitmap::Get(uint32_t id) const {
+  if (!roaring_bitmap_contains(exists_.get(), id)) {
+    return std::nullopt;
+  }
+  uint64_t bits = 0;
+  for (int i = 0; i < BIT_WIDTH; ++i) {
+    if (roaring_bitmap_contains(slices_[i].get(), id)) {
+      bits |= 1ULL << i;
+    }
+  }
+  return (int64_t)(bits ^ (1ULL << 63));
+}
+
+void BitSlicedBitmap::AddMany(const roaring_bitmap_t* ids, int64_t value) {
+  uint64_t bits = EncodeValue(value);
+  roaring_bitmap_or_inplace(MutableBitmap(&exists_), ids);
+  for (int i = 0; i < BIT_WIDTH; ++i) {
+    if ((bits >> i) & 1) {
+      roaring_bitmap_or_inplace(slices_[i].get(), ids);
+    }
+  }
+}
+
+// 从高位到低位逐位比较：`eq` 为目前各位都与 `value` 相同的 id，在 `value` 为 1 的位上
+// `eq` 中为 0 的 id 小于 `value`，在 `value` 为 0 的位上 `eq` 中为 1 的 id 大于 `value`
+roaring_bitmap_ptr BitSlicedBitmap::Query(Compare op, int64_t value) const {
+  uint64_t bits = EncodeValue(value);
+  bool need_lt = op == Compare::LESS || op == Compare::LESS_EQUAL;
+  bool need_gt = op == Compare::GREATER || op == Compare::GREATER_EQUAL;
+  auto eq = NewBitmap(roaring_bitmap_copy(exists_.get()));
+  auto lt = NewBitmap();
+  auto gt = NewBitmap();
+  for (int i = BIT_WIDTH - 1; i >= 0 && !roaring_bitmap_is_empty(eq.get()); --i) {
+    const roaring_bitmap_t* slice = slices_[i].get();
+    if ((bits >> i) & 1) {
+      if (need_lt) {
+        auto diff = NewBitmap(roaring_bitmap_andnot(eq.get(), slice));
+        roaring_bitmap_or_inplace(lt.get(), diff.get());
+      }
+      roaring_bitmap_and_inplace(eq.get(), slice);
+    } else {
+      if (need_gt) {
+        auto diff = NewBitmap(roaring_bitmap_and(eq.get(), slice));
+        roaring_bitmap_or_inplace(gt.get(), diff.get());
+      }
+      roaring_bitmap_andnot_inplace(eq.get(), slice);
+    }
+  }
+
+  switch (op) {
+    case Compare::EQUAL:
+      return eq;
+    case Compare::LESS:
+      return lt;
+    case Compare::LESS_EQUAL:
+      roaring_bitmap_or_inplace(lt.get(), eq.get());
+      return lt;
+    case Compare::GREATER:
+      return gt;
+    case Compare::GREATER_EQUAL:
+      roaring_bitmap_or_inplace(gt.get(), eq.get());
+      return gt;
+  }
+  return NewBitmap();
+}
+
+roaring_bitmap_ptr BitSlicedBitmap::Range(int64_t lower, int64_t upper) const {
+  if (lower > upper) {
+    return NewBitmap();
+  }
+  auto bitmap = Query(Compare::GREATER_EQUAL, lower);
+  auto le = Query(Compare::LESS_EQUAL, upper);
+  roaring_bitmap_and_inplace(bitmap.get(), le.get());
+  return bitmap;
+}
+
 /************************************************************************/
 /* FieldBitmap */
 /************************************************************************/
-void FieldBitmap::UpdateFiledValue(int64_t id, const std::string& field_name, int64_t new_value,
-                                   std::optional<int64_t> old_value) {
+bool FieldBitmap::UpdateFiledValue(uint32_t id, const std::string& field_name,
+                                   const service::FieldValue& new_value) {
+  FieldType type = FieldType::INT64;
+  bool valid = ValidateFieldValue(new_value) && ToFieldType(new_value, &type);
+  std::unique_lock lock(mutex_);
+  // 新值进不了位图时也要清掉旧值，否则 KV 中已是新值，旧值的条件仍能匹配到该 id
+  auto skip = [&] {
+    if (RemoveCode(id, field_name)) {
+      field_versions_[field_name] = ++version_;
+    }
+    return false;
+  };
+  if (!valid) {
+    LOG(WARNING) << "Invalid field value, id=" << id << ",field=" << field_name << ".";
+    return skip();
+  }
+  auto type_it = field_types_.emplace(field_name, type).first;
+  if (type_it->second != type) {
+    LOG(WARNING) << "Mismatched field type, id=" << id << ",field=" << field_name
+                 << ",field_type=" << (int32_t)type_it->second << ",value_type=" << (int32_t)type << ".";
+    return skip();
+  }
+  UpdateCode(id, field_name, AssignCode(field_name, new_value));
+  field_versions_[field_name] = ++version_;
+  return true;
+}
+
+// 旧值取自位切片而不是调用方：WAL 回放时 KV 中的记录可能比位图新，按它清理会留下错误的位
+void FieldBitmap::UpdateCode(uint32_t id, const std::string& field_name, int64_t new_value) {
   auto it = field_bitmap_.find(field_name);
   if (it == field_bitmap_.end()) {
     AddFieldValue(id, field_name, new_value);
+    field_bsi_[field_name].Add(id, new_value);
     return;
   }
 
   // 先清理旧 `value` 中的位图
   // TODO(cong): 删除空的 key?
   auto& value_map = it->second;
-  auto old_bitmap_it = (old_value.has_value()) ? value_map.find(old_value.value()) : value_map.end();
-  if (old_bitmap_it != value_map.end()) {
-    roaring_bitmap_t* old_bitmap = old_bitmap_it->second.get();
-    roaring_bitmap_remove(old_bitmap, id);
+  auto& bsi = field_bsi_[field_name];
+  if (bsi.Get(id) == new_value) {
+    return;
   }
+  RemoveCode(id, field_name);
+  bsi.Add(id, new_value);
 
   // 修改新 `value` 中的位图
   auto new_bitmap_it = value_map.find(new_value);
   if (new_bitmap_it == value_map.end()) {
     AddFieldValue(id, field_name, new_value);
   } else {
-    roaring_bitmap_t* new_bitmap = new_bitmap_it->second.get();
-    roaring_bitmap_add(new_bitmap, id);
+    roaring_bitmap_add(MutableBitmap(&new_bitmap_it->second), id);
   }
 }
 
-roaring_bitmap_ptr FieldBitmap::GetBitmap(const std::string& field_name, int64_t value, Operation op) {
-  roaring_bitmap_ptr bitmap(roaring_bitmap_create(), roaring_bitmap_free);
-  if (auto it = field_bitmap_.find(field_name); it != field_bitmap_.end()) {
-    const auto& value_map = it->second;
-    if (op == Operation::EQUAL) {
+bool FieldBitmap::RemoveCode(uint32_t id, const std::string& field_name) {
+  auto bsi_it = field_bsi_.find(field_name);
+  if (bsi_it == field_bsi_.end()) {
+    return false;
+  }
+  auto old_value = bsi_it->second.Get(id);
+  if (!old_value.has_value()) {
+    return false;
+  }
+  auto it = field_bitmap_.find(field_name);
+  if (it != field_bitmap_.end()) {
+    auto bitmap_it = it->second.find(old_value.value());
+    if (bitmap_it != it->second.end()) {
+      roaring_bitmap_remove(MutableBitmap(&bitmap_it->second), id);
+    }
+  }
+  bsi_it->second.Remove(id);
+  return true;
+}
+
+roaring_bitmap_ptr FieldBitmap::GetBitmap(const std::string& field_name, int64_t value, Operation op,
+                                          int64_t upper) const {
+  std::shared_lock lock(mutex_);
+  return Lookup(field_name, value, op, upper);
+}
+
+bool FieldBitmap::Evaluate(const service::FilterExpression& expr, roaring_bitmap_ptr* result) const {
+  std::shared_lock lock(mutex_);
+  return EvaluateExpression(expr, false, result);
+}
+
+void FieldBitmap::GetVersions(const std::vector<std::string>& field_names, std::vector<uint64_t>* versions) const {
+  std::shared_lock lock(mutex_);
+  versions->clear();
+  for (const auto& field_name : field_names) {
+    auto it = field_versions_.find(field_name);
+    versions->push_back(it != field_versions_.end() ? it->second : 0);
+  }
+}
+
+roaring_bitmap_ptr FieldBitmap::Lookup(const std::string& field_name, int64_t value, Operation op,
+                                       int64_t upper) const {
+  auto it = field_bitmap_.find(field_name);
+  auto bsi_it = field_bsi_.find(field_name);
+  if (it == field_bitmap_.end() || bsi_it == field_bsi_.end()) {
+    return NewBitmap();
+  }
+  const auto& value_map = it->second;
+  const auto& bsi = bsi_it->second;
+  switch (op) {
+    case Operation::EQUAL: {
+      auto bitmap_it = value_map.find(value);
+      return bitmap_it != value_map.end() ? bitmap_it->second : NewBitmap();
+    }
+    case Operation::NOT_EQUAL: {
       auto bitmap_it = value_map.find(value);
-      if (bitmap_it != value_map.end()) {
-        roaring_bitmap_or_inplace(bitmap.get(), bitmap_it->second.get());
+      if (bitmap_it == value_map.end()) {
+        return bsi.Exists();
       }
-    } else if (op == Operation::NOT_EQUAL) {
-      for (const auto& entry : value_map) {
-        if (entry.first != value) {
-          roaring_bitmap_or_inplace(bitmap.get(), entry.second.get());
+      return NewBitmap(roaring_bitmap_andnot(bsi.Exists().get(), bitmap_it->second.get()));
+    }
+    case Operation::LESS:
+      return bsi.Query(BitSlicedBitmap::Compare::LESS, value);
+    case Operation::LESS_EQUAL:
+      return bsi.Query(BitSlicedBitmap::Compare::LESS_EQUAL, value);
+    case Operation::GREATER:
+      return bsi.Query(BitSlicedBitmap::Compare::GREATER, value);
+    case Operation::GREATER_EQUAL:
+      return bsi.Query(BitSlicedBitmap::Compare::GREATER_EQUAL, value);
+    case Operation::BETWEEN:
+      return bsi.Range(value, upper);
+  }
+  return NewBitmap();
+}
+
+roaring_bitmap_ptr FieldBitmap::LookupIn(const std::string& field_name, const std::vector<int64_t>& codes) const {
+  auto it = field_bitmap_.find(field_name);
+  if (it == field_bitmap_.end()) {
+    return NewBitmap();
+  }
+  std::vector<const roaring_bitmap_t*> bitmaps;
+  for (int64_t value : codes) {
+    auto bitmap_it = it->second.find(value);
+    if (bitmap_it != it->second.end()) {
+      bitmaps.push_back(bitmap_it->second.get());
+    }
+  }
+  return bitmaps.empty() ? NewBitmap() : NewBitmap(roaring_bitmap_or_many(bitmaps.size(), bitmaps.data()));
+}
+
+roaring_bitmap_ptr FieldBitmap::Complement(const std::string& field_name, const roaring_bitmap_ptr& bitmap) const {
+  auto it = field_bsi_.find(field_name);
+  if (it == field_bsi_.end()) {
+    return NewBitmap();
+  }
+  return NewBitmap(roaring_bitmap_andnot(it->second.Exists().get(), bitmap.get()));
+}
+
+int64_t FieldBitmap::AssignCode(const std::string& field_name, const service::FieldValue& value) {
+  switch (value.value_case()) {
+    case service::FieldValue::kFloatValue:
+      return EncodeFloat(value.float_value());
+    case service::FieldValue::kStringValue: {
+      auto& dict = field_dicts_[field_name];
+      auto [it, inserted] = dict.codes.emplace(value.string_value(), (int64_t)dict.values.size());
+      if (inserted) {
+        dict.values.push_back(value.string_value());
+      }
+      return it->second;
+    }
+    case service::FieldValue::kBoolValue:
+      return value.bool_value() ? 1 : 0;
+    default:
+      return value.int_value();
+  }
+}
+
+bool FieldBitmap::FindCode(const std::string& field_name, FieldType type, const service::FieldValue& value,
+                           std::optional<int64_t>* code) const {
+  code->reset();
+  switch (type) {
+    case FieldType::INT64:
+      if (value.value_case() != service::FieldValue::kIntValue) {
+        return false;
+      }
+      *code = value.int_value();
+      return true;
+    case FieldType::FLOAT:
+      if (value.value_case() == service::FieldValue::kIntValue) {
+        *code = EncodeFloat((double)value.int_value());
+        return true;
+      }
+      if (value.value_case() != service::FieldValue::kFloatValue || std::isnan(value.float_value())) {
+        return false;
+      }
+      *code = EncodeFloat(value.float_value());
+      return true;
+    case FieldType::STRING: {
+      if (value.value_case() != service::FieldValue::kStringValue) {
+        return false;
+      }
+      auto dict_it = field_dicts_.find(field_name);
+      if (dict_it != field_dicts_.end()) {
+        auto it = dict_it->second.codes.find(value.string_value());
+        if (it != dict_it->second.codes.end()) {
+          *code = it->second;
         }
       }
+      return true;
     }
+    case FieldType::BOOL:
+      if (value.value_case() != service::FieldValue::kBoolValue) {
+        return false;
+      }
+      *code = value.bool_value() ? 1 : 0;
+      return true;
   }
-  return bitmap;
+  return false;
+}
+
+// 未设置带类型的值时使用 int64 的 `value`/`upper`/`values`
+bool FieldBitmap::EvaluateCondition(const service::FilterCondition& cond, bool negated,
+                                    roaring_bitmap_ptr* result) const {
+  bool in = cond.op() == "in";
+  Operation op = Operation::EQUAL;
+  if (!in && !StringToOperation(cond.op(), &op)) {
+    LOG(WARNING) << "Invalid filter op=" << cond.op() << ".";
+    return false;
+  }
+  auto type_it = field_types_.find(cond.field());
+  if (type_it == field_types_.end()) {
+    *result = NewBitmap();
+    return true;
+  }
+  FieldType type = type_it->second;
+  bool range = op != Operation::EQUAL && op != Operation::NOT_EQUAL;
+  if (type == FieldType::STRING && range) {
+    LOG(WARNING) << "Range filter is not supported on string field=" << cond.field() << ".";
+    return false;
+  }
+
+  auto find = [&](const service::FieldValue& value, std::optional<int64_t>* code) {
+    if (FindCode(cond.field(), type, value, code)) {
+      return true;
+    }
+    LOG(WARNING) << "Mismatched filter value type, field=" << cond.field() << ".";
+    return false;
+  };
+  std::optional<int64_t> code;
+  if (in) {
+    std::vector<int64_t> codes;
+    auto add = [&](const service::FieldValue& value) {
+      if (!find(value, &code)) {
+        return false;
+      }
+      if (code) {
+        codes.push_back(*code);
+      }
+      return true;
+    };
+    for (int64_t value : cond.values()) {
+      if (!add(IntFieldValue(value))) {
+        return false;
+      }
+    }
+    for (const auto& value : cond.typed_values()) {
+      if (!add(value)) {
+        return false;
+      }
+    }
+    *result = LookupIn(cond.field(), codes);
+    if (negated) {
+      *result = Complement(cond.field(), *result);
+    }
+    return true;
+  }
+
+  std::optional<int64_t> upper;
+  if (!find(cond.has_typed_value() ? cond.typed_value() : IntFieldValue(cond.value()), &code)) {
+    return false;
+  }
+  if (op == Operation::BETWEEN &&
+      !find(cond.has_typed_upper() ? cond.typed_upper() : IntFieldValue(cond.upper()), &upper)) {
+    return false;
+  }
+  // 只有字典中没有的 string 取不到编码，此时只会是等值类查询，-1 不对应任何取值
+  if (negated && op != Operation::BETWEEN) {
+    op = NegateOperation(op);
+  }
+  *result = Lookup(cond.field(), code.value_or(-1), op, upper.value_or(0));
+  if (negated && op == Operation::BETWEEN) {
+    *result = Complement(cond.field(), *result);
+  }
+  return true;
+}
+
+// 三值逻辑：id 没有某字段的取值时，该字段上的条件既不为真也不为假。`negated` 为 true 时求结果为假的 id，
+// `not` 由 De Morgan 律下推到叶子，不依赖其他字段。单个叶子直接返回查到的位图，不再额外拷贝
+bool FieldBitmap::EvaluateExpression(const service::FilterExpression& expr, bool negated,
+                                     roaring_bitmap_ptr* result) const {
+  if (expr.op().empty()) {
+    return EvaluateCondition(expr.condition(), negated, result);
+  } else if (expr.op() == "and" || expr.op() == "or") {
+    if (expr.children_size() == 0) {
+      LOG(WARNING) << "Invalid filter expression, empty " << expr.op() << ".";
+      return false;
+    }
+    // 取反后 and 与 or 互换
+    return (expr.op() == "and") != negated ? EvaluateAnd(expr, negated, result) : EvaluateOr(expr, negated, result);
+  } else if (expr.op() == "not" && expr.children_size() == 1) {
+    return EvaluateExpression(expr.children(0), !negated, result);
+  }
+  LOG(WARNING) << "Invalid filter expression, op=" << expr.op() << ",children=" << expr.children_size() << ".";
+  return false;
+}
+
+// 子节点按基数从小到大求交，结果为空时提前结束。
+// 子节点的结果可能是共享的，第一次运算生成新位图，之后在其上原地运算
+bool FieldBitmap::EvaluateAnd(const service::FilterExpression& expr, bool negated, roaring_bitmap_ptr* result) const {
+  std::vector<std::pair<uint64_t, roaring_bitmap_ptr>> sorted;
+  for (const auto& child : expr.children()) {
+    roaring_bitmap_ptr bitmap;
+    if (!EvaluateExpression(child, negated, &bitmap)) {
+      return false;
+    }
+    uint64_t cardinality = roaring_bitmap_get_cardinality(bitmap.get());
+    sorted.emplace_back(cardinality, std::move(bitmap));
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  roaring_bitmap_ptr acc = std::move(sorted[0].second);
+  bool owned = false;
+  for (size_t i = 1; i < sorted.size() && !roaring_bitmap_is_empty(acc.get()); ++i) {
+    if (owned) {
+      roaring_bitmap_and_inplace(acc.get(), sorted[i].second.get());
+    } else {
+      acc = NewBitmap(roaring_bitmap_and(acc.get(), sorted[i].second.get()));
+      owned = true;
+    }
+  }
+  *result = std::move(acc);
+  return true;
+}
+
+bool FieldBitmap::EvaluateOr(const service::FilterExpression& expr, bool negated, roaring_bitmap_ptr* result) const {
+  std::vector<roaring_bitmap_ptr> children;
+  std::vector<const roaring_bitmap_t*> bitmaps;
+  for (const auto& child : expr.children()) {
+    roaring_bitmap_ptr bitmap;
+    if (!EvaluateExpression(child, negated, &bitmap)) {
+      return false;
+    }
+    bitmaps.push_back(bitmap.get());
+    children.push_back(std::move(bitmap));
+  }
+  *result = children.size() == 1 ? std::move(children[0])
+                                  : NewBitmap(roaring_bitmap_or_many(bitmaps.size(), bitmaps.data()));
+  return true;
 }
 
 /**
+ *
+ * Format of schema (absent in the old format, where every field is int64):
+ * ----------------------------------------------------------------------------
+ * | Magic (8) | FieldCount (8) |
+ * ----------------------------------------------------------------------------
+ * Each field:
+ * | FieldNameSize (8) | FieldNameData | Type (1) | DictSize (8) |
+ * ----------------------------------------------------------------------------
+ * | (StringSize (8) | StringData) * DictSize |
+ * ----------------------------------------------------------------------------
  *
  * Format of each record:
  * ----------------------------------------------------------------------------
@@ -68,8 +572,28 @@ roaring_bitmap_ptr FieldBitmap::GetBitmap(const std::string& field_name, int64_t
  * ----------------------------------------------------------------------------
  *
  */
-std::string FieldBitmap::SerializeToString() {
+std::string FieldBitmap::SerializeToString() const {
   std::ostringstream oss;
+  std::shared_lock lock(mutex_);
+  auto write_u64 = [&oss](uint64_t value) { oss.write((const char*)&value, 8); };
+  write_u64(SCHEMA_MAGIC);
+  write_u64(field_types_.size());
+  for (const auto& [field_name, type] : field_types_) {
+    write_u64(field_name.size());
+    oss << field_name;
+    oss.put((char)type);
+    auto dict_it = field_dicts_.find(field_name);
+    if (dict_it == field_dicts_.end()) {
+      write_u64(0);
+      continue;
+    }
+    write_u64(dict_it->second.values.size());
+    for (const auto& value : dict_it->second.values) {
+      write_u64(value.size());
+      oss << value;
+    }
+  }
+
   for (const auto& field_entry : field_bitmap_) {
     const std::string& field_name = field_entry.first;
     const auto& value_map = field_entry.second;
@@ -115,7 +639,62 @@ std::string FieldBitmap::SerializeToString() {
 }
 
 bool FieldBitmap::ParseFromString(const std::string& data) {
+  std::unique_lock lock(mutex_);
   uint64_t offset = 0;
+  auto read = [&](void* dst, uint64_t size) {
+    if (data.size() - offset < size) {
+      return false;
+    }
+    std::memcpy(dst, data.data() + offset, size);
+    offset += size;
+    return true;
+  };
+  auto read_string = [&](std::string* str) {
+    uint64_t size = 0;
+    if (!read(&size, 8) || data.size() - offset < size) {
+      return false;
+    }
+    str->assign(data.data() + offset, size);
+    offset += size;
+    return true;
+  };
+
+  uint64_t magic = 0;
+  if (data.size() >= 8) {
+    std::memcpy(&magic, data.data(), 8);
+  }
+  if (magic == SCHEMA_MAGIC) {
+    offset = 8;
+    uint64_t num_fields = 0;
+    if (!read(&num_fields, 8)) {
+      LOG(WARNING) << "Failed to parse field schema.";
+      return false;
+    }
+    for (uint64_t i = 0; i < num_fields; ++i) {
+      std::string field_name;
+      uint8_t type = 0;
+      uint64_t dict_size = 0;
+      if (!read_string(&field_name) || !read(&type, 1) || type > (uint8_t)FieldType::BOOL || !read(&dict_size, 8)) {
+        LOG(WARNING) << "Failed to parse field schema.";
+        return false;
+      }
+      field_types_[field_name] = (FieldType)type;
+      if (dict_size == 0) {
+        continue;
+      }
+      auto& dict = field_dicts_[field_name];
+      for (uint64_t j = 0; j < dict_size; ++j) {
+        std::string value;
+        if (!read_string(&value)) {
+          LOG(WARNING) << "Failed to parse field dictionary, field=" << field_name << ".";
+          return false;
+        }
+        dict.codes.emplace(value, (int64_t)dict.values.size());
+        dict.values.push_back(std::move(value));
+      }
+    }
+  }
+
   while (offset < data.size()) {
     uint64_t total_size;
     std::memcpy(&total_size, data.data() + offset, 8);
@@ -141,15 +720,74 @@ bool FieldBitmap::ParseFromString(const std::string& data) {
 
     roaring_bitmap_ptr p(roaring_bitmap_portable_deserialize(bitmap_str.data()), roaring_bitmap_free);
     field_bitmap_[field_name][value] = std::move(p);
+    // 旧格式没有类型信息，都是 int64 字段
+    field_types_.emplace(field_name, FieldType::INT64);
+  }
+
+  ++version_;
+  for (const auto& [field_name, type] : field_types_) {
+    field_versions_[field_name] = version_;
+  }
+
+  // 位切片索引不随快照保存，由各取值的位图重建
+  field_bsi_.clear();
+  for (const auto& [field_name, value_map] : field_bitmap_) {
+    auto& bsi = field_bsi_[field_name];
+    for (const auto& [value, bitmap] : value_map) {
+      bsi.AddMany(bitmap.get(), value);
+    }
   }
   return true;
 }
 
-void FieldBitmap::AddFieldValue(int64_t id, const std::string& field_name, int64_t value) {
+void FieldBitmap::AddFieldValue(uint32_t id, const std::string& field_name, int64_t value) {
   roaring_bitmap_ptr bitmap(roaring_bitmap_create(), roaring_bitmap_free);
   roaring_bitmap_add(bitmap.get(), id);
   field_bitmap_[field_name][value] = std::move(bitmap);
-  LOG(INFO) << "Added int field filter: id=" << id << ",field=" << field_name << ",value=" << value << ".";
+  LOG(INFO) << "Added field filter: id=" << id << ",field=" << field_name << ",value=" << value << ".";
+}
+
+/************************************************************************/
+/* FieldBitmap functions */
+/************************************************************************/
+bool StringToOperation(const std::string& str, FieldBitmap::Operation* op) {
+  if (str == "=") {
+    *op = FieldBitmap::Operation::EQUAL;
+  } else if (str == "!=") {
+    *op = FieldBitmap::Operation::NOT_EQUAL;
+  } else if (str == "<") {
+    *op = FieldBitmap::Operation::LESS;
+  } else if (str == "<=") {
+    *op = FieldBitmap::Operation::LESS_EQUAL;
+  } else if (str == ">") {
+    *op = FieldBitmap::Operation::GREATER;
+  } else if (str == ">=") {
+    *op = FieldBitmap::Operation::GREATER_EQUAL;
+  } else if (str == "between") {
+    *op = FieldBitmap::Operation::BETWEEN;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ValidateFieldValue(const service::FieldValue& value) {
+  return value.value_case() != service::FieldValue::VALUE_NOT_SET &&
+         !(value.value_case() == service::FieldValue::kFloatValue && std::isnan(value.float_value()));
+}
+
+bool ValidateFilter(const service::FilterExpression& expr) {
+  if (expr.op().empty()) {
+    FieldBitmap::Operation op;
+    const auto& cond = expr.condition();
+    return expr.children_size() == 0 && (cond.op() == "in" || StringToOperation(cond.op(), &op));
+  }
+  if (expr.op() == "not" ? expr.children_size() != 1
+                         : (expr.op() != "and" && expr.op() != "or") || expr.children_size() == 0) {
+    return false;
+  }
+  return std::all_of(expr.children().begin(), expr.children().end(),
+                     [](const service::FilterExpression& child) { return ValidateFilter(child); });
 }
 
 }  // namespace vdb
@@ -1,40 +1,158 @@
 #pragma once
 
+#include <gen_cpp/vdb.pb.h>
 #include <roaring/roaring.h>
 #include <stdint.h>
 #include <memory>
+#include <optional>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace vdb {
 
 using roaring_bitmap_ptr = std::shared_ptr<roaring_bitmap_t>;
 
+/************************************************************************/
+/* BitSlicedBitmap */
+/************************************************************************/
+// int64 字段的位切片索引：第 i 个位图记录编码后第 i 位为 1 的 id，比较/范围查询固定为 64 轮位图运算，
+// 与字段不同取值的个数无关。编码时翻转符号位，使无符号的比较顺序与有符号一致。由调用方加锁。
+class BitSlicedBitmap {
+ public:
+  enum class Compare {
+    EQUAL,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+  };
+
+ private:
+  static constexpr int BIT_WIDTH = 64;
+  // 有该字段的全部 id，与 `FieldBitmap` 的其他位图一样写时复制
+  roaring_bitmap_ptr exists_;
+  std::vector<roaring_bitmap_ptr> slices_;
+
+ public:
+  BitSlicedBitmap();
+
+ public:
+  void Add(uint32_t id, int64_t value);
+  // 从 `exists_` 与全部切片中清除 `id`，与它原来的取值无关
+  void Remove(uint32_t id);
+  // `ids` 中的 id 取值均为 `value`
+  void AddMany(const roaring_bitmap_t* ids, int64_t value);
+
+ public:
+  // 返回的位图可能被共享，调用方不能修改
+  [[nodiscard]] roaring_bitmap_ptr Exists() const { return exists_; }
+  // 由各切片还原 `id` 当前存储的取值，没有该字段时为空
+  [[nodiscard]] std::optional<int64_t> Get(uint32_t id) const;
+  [[nodiscard]] roaring_bitmap_ptr Query(Compare op, int64_t value) const;
+  // 闭区间 `[lower, upper]`
+  [[nodiscard]] roaring_bitmap_ptr Range(int64_t lower, int64_t upper) const;
+};
+
 /************************************************************************/
 /* FieldBitmap */
 /************************************************************************/
+// 所有类型的字段值都编码为 int64 后存入同一套位图：bool 为 0/1，float 按保序编码，
+// string 按字段内的字典分配编码（只支持等值类查询），过滤始终是纯位图运算
 class FieldBitmap {
  public:
+  // 字段类型由第一次写入的值确定
+  enum class FieldType : uint8_t {
+    INT64 = 0,
+    FLOAT = 1,
+    STRING = 2,
+    BOOL = 3,
+  };
+
   enum class Operation {
     EQUAL,
     NOT_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    // 闭区间 `[value, upper]`
+    BETWEEN,
   };
 
  private:
-  // TODO(cong): 支持多类型？
+  // 读写锁。查询结果可能直接共享内部位图（写时复制）：写入时若位图仍被查询方引用，
+  // 先拷贝一份再修改，已返回的结果保持不变
+  mutable std::shared_mutex mutex_;
+  // 等值查询直接取对应编码的位图
   std::unordered_map<std::string, std::unordered_map<int64_t, roaring_bitmap_ptr>> field_bitmap_;
+  // 范围查询使用位切片索引，不随快照保存，加载时由 `field_bitmap_` 重建
+  std::unordered_map<std::string, BitSlicedBitmap> field_bsi_;
+  std::unordered_map<std::string, FieldType> field_types_;
+  // string 字段的字典，编码为字符串在 `values` 中的下标
+  struct Dictionary {
+    std::unordered_map<std::string, int64_t> codes;
+    std::vector<std::string> values;
+  };
+  std::unordered_map<std::string, Dictionary> field_dicts_;
+  // 每次修改递增，字段记录最后一次修改时的值，供缓存判断失效
+  uint64_t version_{0};
+  std::unordered_map<std::string, uint64_t> field_versions_;
 
  public:
-  void UpdateFiledValue(int64_t id, const std::string& field_name, int64_t new_value,
-                        std::optional<int64_t> old_value = {});
-  [[nodiscard]] roaring_bitmap_ptr GetBitmap(const std::string& field_name, int64_t value, Operation op);
+  // `id` 为 `IdMap` 分配的内部 id；旧值以位图中实际存储的为准。
+  // 值不合法或类型与字段已有的类型不同时不写入，只清除旧值并返回 false
+  [[nodiscard]] bool UpdateFiledValue(uint32_t id, const std::string& field_name, const service::FieldValue& new_value);
+  // 只用于 int64 字段；`upper` 仅用于 `BETWEEN`；结果可能与内部共享，调用方不能修改
+  [[nodiscard]] roaring_bitmap_ptr GetBitmap(const std::string& field_name, int64_t value, Operation op,
+                                             int64_t upper = 0) const;
+  // 在同一把读锁下求整棵表达式树的结果；表达式不合法时返回 false。
+  // 结果可能与内部或其他调用共享，调用方不能修改
+  [[nodiscard]] bool Evaluate(const service::FilterExpression& expr, roaring_bitmap_ptr* result) const;
+  // 字段每次修改后版本号都会变大，不存在的字段为 0
+  void GetVersions(const std::vector<std::string>& field_names, std::vector<uint64_t>* versions) const;
 
  public:
-  [[nodiscard]] std::string SerializeToString();
+  [[nodiscard]] std::string SerializeToString() const;
   [[nodiscard]] bool ParseFromString(const std::string& data);
 
  private:
-  void AddFieldValue(int64_t id, const std::string& field_name, int64_t value);
+  void AddFieldValue(uint32_t id, const std::string& field_name, int64_t value);
+
+  // 以下需持有锁
+  void UpdateCode(uint32_t id, const std::string& field_name, int64_t new_value);
+  // 从该字段的位图中清除 `id` 当前存储的取值，没有时返回 false
+  bool RemoveCode(uint32_t id, const std::string& field_name);
+  // 写入时编码，string 不在字典中时分配新编码；`value` 与字段类型相同
+  [[nodiscard]] int64_t AssignCode(const std::string& field_name, const service::FieldValue& value);
+  // 查询时编码，int64 也可用于 float 字段；类型不符时返回 false，string 不在字典中时 `code` 为空
+  [[nodiscard]] bool FindCode(const std::string& field_name, FieldType type, const service::FieldValue& value,
+                              std::optional<int64_t>* code) const;
+  [[nodiscard]] roaring_bitmap_ptr Lookup(const std::string& field_name, int64_t value, Operation op,
+                                          int64_t upper) const;
+  [[nodiscard]] roaring_bitmap_ptr LookupIn(const std::string& field_name, const std::vector<int64_t>& codes) const;
+  // 有该字段取值但不在 `bitmap` 中的 id
+  [[nodiscard]] roaring_bitmap_ptr Complement(const std::string& field_name, const roaring_bitmap_ptr& bitmap) const;
+  // `negated` 为 true 时求结果为假的 id
+  [[nodiscard]] bool EvaluateCondition(const service::FilterCondition& cond, bool negated,
+                                       roaring_bitmap_ptr* result) const;
+  [[nodiscard]] bool EvaluateExpression(const service::FilterExpression& expr, bool negated,
+                                        roaring_bitmap_ptr* result) const;
+  [[nodiscard]] bool EvaluateAnd(const service::FilterExpression& expr, bool negated,
+                                 roaring_bitmap_ptr* result) const;
+  [[nodiscard]] bool EvaluateOr(const service::FilterExpression& expr, bool negated,
+                                roaring_bitmap_ptr* result) const;
 };
 
+/************************************************************************/
+/* FieldBitmap functions */
+/************************************************************************/
+// "=", "!=", "<", "<=", ">", ">=", "between"
+[[nodiscard]] bool StringToOperation(const std::string& str, FieldBitmap::Operation* op);
+// 检查表达式树的结构与各叶子的 op
+[[nodiscard]] bool ValidateFilter(const service::FilterExpression& expr);
+// 值已设置且不是 NaN
+[[nodiscard]] bool ValidateFieldValue(const service::FieldValue& value);
+
 }  // namespace vdb
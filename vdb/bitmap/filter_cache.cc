@@ -0,0 +1,173 @@
+#include "bitmap/filter_cache.h"
+#include <roaring/roaring.h>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace vdb {
+
+namespace {
+
+// 单个等值条件一定直接返回已存储的位图，不必规范化就能跳过缓存
+bool IsSingleEqual(const service::FilterExpression& expr) {
+  return expr.op().empty() && expr.condition().op() == "=";
+}
+
+// 每种取值都是自定界的：类型前缀 + 内容，字符串带长度
+std::string FieldValueKey(const service::FieldValue& value) {
+  switch (value.value_case()) {
+    case service::FieldValue::kFloatValue: {
+      uint64_t bits = 0;
+      double d = value.float_value();
+      std::memcpy(&bits, &d, 8);
+      return "f" + std::to_string(bits);
+    }
+    case service::FieldValue::kStringValue:
+      return "s" + std::to_string(value.string_value().size()) + ":" + value.string_value();
+    case service::FieldValue::kBoolValue:
+      return value.bool_value() ? "b1" : "b0";
+    default:
+      return "i" + std::to_string(value.int_value());
+  }
+}
+
+std::string IntValueKey(int64_t value) { return "i" + std::to_string(value); }
+
+std::string ConditionKey(const service::FilterCondition& cond) {
+  std::string key = std::to_string(cond.field().size()) + ":" + cond.field() + " " + cond.op();
+  if (cond.op() == "in") {
+    std::vector<std::string> values;
+    for (int64_t value : cond.values()) {
+      values.push_back(IntValueKey(value));
+    }
+    for (const auto& value : cond.typed_values()) {
+      values.push_back(FieldValueKey(value));
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    for (const auto& value : values) {
+      key += " " + value;
+    }
+    return key;
+  }
+  key += " " + (cond.has_typed_value() ? FieldValueKey(cond.typed_value()) : IntValueKey(cond.value()));
+  if (cond.op() == "between") {
+    key += " " + (cond.has_typed_upper() ? FieldValueKey(cond.typed_upper()) : IntValueKey(cond.upper()));
+  }
+  return key;
+}
+
+std::string NormalizeExpression(const service::FilterExpression& expr, std::vector<std::string>* fields) {
+  if (expr.op().empty()) {
+    fields->push_back(expr.condition().field());
+    return ConditionKey(expr.condition());
+  }
+  std::vector<std::string> children;
+  for (const auto& child : expr.children()) {
+    children.push_back(NormalizeExpression(child, fields));
+  }
+  if (expr.op() != "not") {
+    std::sort(children.begin(), children.end());
+    children.erase(std::unique(children.begin(), children.end()), children.end());
+    if (children.size() == 1) {
+      return children[0];
+    }
+  }
+  // 子节点带长度，避免字符串取值中的括号造成歧义
+  std::string key = expr.op() + "(";
+  for (const auto& child : children) {
+    key += std::to_string(child.size()) + ":" + child;
+  }
+  return key + ")";
+}
+
+}  // namespace
+
+/************************************************************************/
+/* FilterCache */
+/************************************************************************/
+// 先取版本号再求值：求值期间若有写入，条目记录的是旧版本号，下次查找时自然失效
+bool FilterCache::Evaluate(const FieldBitmap& field_bitmap, const service::FilterExpression& expr,
+                           roaring_bitmap_ptr* result, Status* status) {
+  *status = Status::UNCACHED;
+  if (capacity_ == 0 || IsSingleEqual(expr)) {
+    return field_bitmap.Evaluate(expr, result);
+  }
+
+  Entry entry;
+  entry.key = NormalizeFilter(expr, &entry.fields);
+  field_bitmap.GetVersions(entry.fields, &entry.versions);
+  if (Get(entry.key, entry.versions, result)) {
+    *status = Status::HIT;
+    return true;
+  }
+  if (!field_bitmap.Evaluate(expr, result)) {
+    return false;
+  }
+  // 结果仍被 `field_bitmap` 引用时就是已存储的位图（如只有一个子节点的 and/or、取值不存在的 !=），
+  // 本身无需计算，缓存它反而会让写入时触发写时复制
+  if (result->use_count() > 1) {
+    return true;
+  }
+  *status = Status::MISS;
+  entry.bitmap = *result;
+  Put(std::move(entry));
+  return true;
+}
+
+bool FilterCache::Get(const std::string& key, const std::vector<uint64_t>& versions, roaring_bitmap_ptr* result) {
+  std::lock_guard lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return false;
+  }
+  if (it->second->versions != versions) {
+    bytes_ -= it->second->bytes;
+    lru_.erase(it->second);
+    entries_.erase(it);
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  *result = it->second->bitmap;
+  return true;
+}
+
+// 大小按序列化后的位图估算
+void FilterCache::Put(Entry&& entry) {
+  entry.bytes = sizeof(Entry) + entry.key.size() + roaring_bitmap_portable_size_in_bytes(entry.bitmap.get());
+  for (const auto& field : entry.fields) {
+    entry.bytes += field.size() + sizeof(uint64_t);
+  }
+  if (entry.bytes > capacity_) {
+    return;
+  }
+
+  std::lock_guard lock(mutex_);
+  auto it = entries_.find(entry.key);
+  if (it != entries_.end()) {
+    bytes_ -= it->second->bytes;
+    lru_.erase(it->second);
+    entries_.erase(it);
+  }
+  bytes_ += entry.bytes;
+  lru_.push_front(std::move(entry));
+  entries_.emplace(lru_.front().key, lru_.begin());
+  while (bytes_ > capacity_) {
+    bytes_ -= lru_.back().bytes;
+    entries_.erase(lru_.back().key);
+    lru_.pop_back();
+  }
+}
+
+/************************************************************************/
+/* FilterCache functions */
+/************************************************************************/
+std::string NormalizeFilter(const service::FilterExpression& expr, std::vector<std::string>* fields) {
+  fields->clear();
+  std::string key = NormalizeExpression(expr, fields);
+  std::sort(fields->begin(), fields->end());
+  fields->erase(std::unique(fields->begin(), fields->end()), fields->end());
+  return key;
+}
+
+}  // namespace vdb
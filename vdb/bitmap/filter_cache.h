@@ -0,0 +1,66 @@
+#pragma once
+
+#include <gen_cpp/vdb.pb.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bitmap/field_bitmap.h"
+
+namespace vdb {
+
+/************************************************************************/
+/* FilterCache */
+/************************************************************************/
+// 按规范化后的过滤表达式缓存求值结果的 LRU，总大小不超过 `capacity` 字节。
+// 条目记录求值前各相关字段的版本号，查找时只要有一个版本号变化就视为失效并丢弃。
+class FilterCache {
+ public:
+  enum class Status {
+    // 未启用缓存，或结果直接是 `FieldBitmap` 中已存储的位图
+    UNCACHED,
+    HIT,
+    MISS,
+  };
+
+ private:
+  struct Entry {
+    std::string key;
+    roaring_bitmap_ptr bitmap;
+    // 有序去重的字段名，空字段名表示依赖所有字段
+    std::vector<std::string> fields;
+    std::vector<uint64_t> versions;
+    size_t bytes{0};
+  };
+
+  size_t capacity_{0};
+  std::mutex mutex_;
+  size_t bytes_{0};
+  // 头部为最近使用的条目
+  std::list<Entry> lru_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+
+ public:
+  // 0 表示不缓存
+  void Init(size_t capacity) { capacity_ = capacity; }
+
+  // 与 `FieldBitmap::Evaluate` 相同，结果可能与缓存或 `field_bitmap` 共享，调用方不能修改
+  [[nodiscard]] bool Evaluate(const FieldBitmap& field_bitmap, const service::FilterExpression& expr,
+                              roaring_bitmap_ptr* result, Status* status);
+
+ private:
+  [[nodiscard]] bool Get(const std::string& key, const std::vector<uint64_t>& versions, roaring_bitmap_ptr* result);
+  void Put(Entry&& entry);
+};
+
+/************************************************************************/
+/* FilterCache functions */
+/************************************************************************/
+// 语义相同的表达式得到相同的 key：and/or 的子节点与 in 的取值排序去重，只有一个子节点的 and/or 展开。
+// `fields` 收集用到的字段，`not` 只在子节点用到的字段内求补，不引入其他字段
+[[nodiscard]] std::string NormalizeFilter(const service::FilterExpression& expr, std::vector<std::string>* fields);
+
+}  // namespace vdb
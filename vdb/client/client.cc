@@ -0,0 +1,90 @@
+#include "client/client.h"
+#include <brpc/channel.h>
+#include <brpc/controller.h>
+#include <glog/logging.h>
+
+namespace vdb {
+
+/************************************************************************/
+/* VdbClient::Impl */
+/************************************************************************/
+class VdbClient::Impl {
+ private:
+  brpc::Channel channel_;
+  std::unique_ptr<service::VdbService_Stub> stub_;
+
+ public:
+  bool Init(const InitOptions& opts) {
+    brpc::ChannelOptions options;
+    options.protocol = "baidu_std";
+    options.connect_timeout_ms = opts.connect_timeout_ms;
+    options.timeout_ms = opts.timeout_ms;
+    options.max_retry = opts.max_retry;
+    if (channel_.Init(opts.server_addr.c_str(), &options) != 0) {
+      LOG(WARNING) << "Failed to init channel, server_addr=" << opts.server_addr << ".";
+      return false;
+    }
+    stub_ = std::make_unique<service::VdbService_Stub>(&channel_);
+    return true;
+  }
+
+  bool Upsert(const service::UpsertRequest& req, service::EmptyResponse* resp) {
+    brpc::Controller cntl;
+    stub_->Upsert(&cntl, &req, resp, nullptr);
+    return CheckController(cntl, "Upsert");
+  }
+
+  bool UpsertBatch(const service::UpsertBatchRequest& req, service::EmptyResponse* resp) {
+    brpc::Controller cntl;
+    stub_->UpsertBatch(&cntl, &req, resp, nullptr);
+    return CheckController(cntl, "UpsertBatch");
+  }
+
+  bool Search(const service::SearchRequest& req, service::SearchResponse* resp) {
+    brpc::Controller cntl;
+    stub_->Search(&cntl, &req, resp, nullptr);
+    return CheckController(cntl, "Search");
+  }
+
+  bool Query(const service::QueryRequest& req, service::QueryResponse* resp) {
+    brpc::Controller cntl;
+    stub_->Query(&cntl, &req, resp, nullptr);
+    return CheckController(cntl, "Query");
+  }
+
+ private:
+  static bool CheckController(const brpc::Controller& cntl, const char* method) {
+    if (cntl.Failed()) {
+      LOG(WARNING) << "Failed to call " << method << ", error=" << cntl.ErrorText() << ".";
+      return false;
+    }
+    return true;
+  }
+};
+
+/************************************************************************/
+/* VdbClient */
+/************************************************************************/
+VdbClient::VdbClient() : impl_(std::make_unique<Impl>()) {}
+
+VdbClient::~VdbClient() = default;
+
+bool VdbClient::Init(const InitOptions& opts) { return impl_->Init(opts); }
+
+bool VdbClient::Upsert(const service::UpsertRequest& req, service::EmptyResponse* resp) {
+  return impl_->Upsert(req, resp);
+}
+
+bool VdbClient::UpsertBatch(const service::UpsertBatchRequest& req, service::EmptyResponse* resp) {
+  return impl_->UpsertBatch(req, resp);
+}
+
+bool VdbClient::Search(const service::SearchRequest& req, service::SearchResponse* resp) {
+  return impl_->Search(req, resp);
+}
+
+bool VdbClient::Query(const service::QueryRequest& req, service::QueryResponse* resp) {
+  return impl_->Query(req, resp);
+}
+
+}  // namespace vdb
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <gen_cpp/vdb.pb.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+namespace vdb {
+
+/************************************************************************/
+/* VdbClient */
+/************************************************************************/
+// 基于 baidu_std 协议的同步客户端，可被多个线程共享
+class VdbClient {
+ public:
+  struct InitOptions {
+    // 如 "127.0.0.1:7123"
+    std::string server_addr;
+    int connect_timeout_ms{200};
+    int timeout_ms{1000};
+    int max_retry{3};
+  };
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+
+ public:
+  VdbClient();
+  ~VdbClient();
+
+ public:
+  VdbClient(const VdbClient&) = delete;
+  VdbClient(VdbClient&&) = delete;
+  VdbClient& operator=(const VdbClient&) = delete;
+  VdbClient& operator=(VdbClient&&) = delete;
+
+ public:
+  [[nodiscard]] bool Init(const InitOptions& opts);
+
+ public:
+  // 返回 false 表示 RPC 失败；RPC 成功时业务结果见 `resp->ret_code()`
+  [[nodiscard]] bool Upsert(const service::UpsertRequest& req, service::EmptyResponse* resp);
+  [[nodiscard]] bool UpsertBatch(const service::UpsertBatchRequest& req, service::EmptyResponse* resp);
+  [[nodiscard]] bool Search(const service::SearchRequest& req, service::SearchResponse* resp);
+  [[nodiscard]] bool Query(const service::QueryRequest& req, service::QueryResponse* resp);
+};
+
+}  // namespace vdb
@@ -1,15 +1,46 @@
 #include "db/database.h"
 #include <glog/logging.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 #include "bitmap/field_bitmap.h"
+#include "bitmap/filter_cache.h"
+#include "index/id_map.h"
 #include "index/index.h"
 #include "index/index_factory.h"
 #include "persistence/persistence.h"
+#include "util/blocking_queue.h"
+#include "util/thread_pool.h"
 #include "util/util.h"
 
 namespace vdb {
 
-const uint8_t VERSION = 1;
+// WAL 记录体的格式版本：1 为 JSON 文本，2 为 `UpsertRequest` 的 protobuf 二进制
+const uint8_t WAL_VERSION_JSON = 1;
+const uint8_t WAL_VERSION_PB = 2;
+const uint8_t VERSION = WAL_VERSION_PB;
+
+const size_t REPLAY_BATCH_SIZE = 1024;
+const size_t REPLAY_PROGRESS_INTERVAL = 100000;
+
+// 过滤位图的选择性（命中数 / 索引中的存活向量数）不超过该值时只对命中的 id 精确计算距离
+const double PRE_FILTER_SELECTIVITY = 0.05;
+// 选择性不低于该值时不带过滤条件搜索，按 `POST_FILTER_OVERSAMPLE` 多取结果后再筛选
+const double POST_FILTER_SELECTIVITY = 0.5;
+const double POST_FILTER_OVERSAMPLE = 1.5;
+// HNSW 边搜索边过滤时 ef 按选择性放大，不超过该值
+const int MAX_FILTERED_EF_SEARCH = 4096;
 
 /************************************************************************/
 /* Database::Impl */
@@ -18,70 +49,111 @@ class Database::Impl {
  private:
   IndexFactory index_factory_;
   FieldBitmap field_bitmap_;
+  FilterCache filter_cache_;
+  // 索引 label 与位图使用的内部 id
+  IdMap id_map_;
   Persistence persistence_;
 
+  int dim_{1};
+  StorageType storage_{StorageType::FP32};
+  int rerank_factor_{0};
+  int hnsw_ef_search_{50};
+  size_t replay_threads_{1};
+
+  // 写路径（WAL + 位图/KV/索引更新）与 snapshot 时间点的捕获在此串行，保证 WAL 顺序与应用顺序一致；
+  // 读路径不持有该锁，只依赖各索引与 `FieldBitmap` 内部的读写锁。
+  std::mutex write_mutex_;
+
+  std::mutex snapshot_mutex_;
+  std::atomic<bool> snapshot_running_{false};
+  std::thread snapshot_thread_;
+
+ public:
+  ~Impl() {
+    std::lock_guard lock(snapshot_mutex_);
+    if (snapshot_thread_.joinable()) {
+      snapshot_thread_.join();
+    }
+  }
+
  public:
   bool Init(const InitOptions& opts) {
-    if (!persistence_.Init(opts.persistence_path, VERSION)) {
+    dim_ = opts.dim;
+    storage_ = opts.storage;
+    rerank_factor_ = opts.rerank_factor;
+    hnsw_ef_search_ = opts.hnsw_ef_search;
+    replay_threads_ = opts.replay_threads > 0 ? opts.replay_threads : std::thread::hardware_concurrency();
+    filter_cache_.Init(opts.filter_cache_bytes);
+    Persistence::InitOptions persistence_opts;
+    persistence_opts.path = opts.persistence_path;
+    persistence_opts.version = VERSION;
+    persistence_opts.wal_sync_policy = opts.wal_sync_policy;
+    persistence_opts.wal_sync_interval_ms = opts.wal_sync_interval_ms;
+    persistence_opts.wal_segment_size = opts.wal_segment_size;
+    if (!persistence_.Init(persistence_opts)) {
       return false;
     }
 
-    index_factory_.Add(vdb::service::IndexType::IT_FLAT, vdb::NewFaissIndex(opts.dim, vdb::MetricType::L2));
-    index_factory_.Add(vdb::service::IndexType::IT_HNSW,
-                       vdb::NewHNSWLibIndex(opts.dim, opts.num_data, vdb::MetricType::L2));
+    FlatOptions flat_opts;
+    flat_opts.storage = opts.storage;
+    flat_opts.compact_ratio = opts.flat_compact_ratio;
+    flat_opts.retrain_growth = opts.flat_retrain_growth;
+    index_factory_.Add(vdb::service::IndexType::IT_FLAT, vdb::NewFaissIndex(opts.dim, opts.metric, flat_opts));
+    HNSWOptions hnsw_opts;
+    hnsw_opts.num_data = opts.num_data;
+    hnsw_opts.growth_factor = opts.hnsw_growth_factor;
+    hnsw_opts.compact_ratio = opts.hnsw_compact_ratio;
+    hnsw_opts.ef_search = opts.hnsw_ef_search;
+    hnsw_opts.storage = opts.storage;
+    index_factory_.Add(vdb::service::IndexType::IT_HNSW, vdb::NewHNSWLibIndex(opts.dim, opts.metric, hnsw_opts));
+    index_factory_.Add(vdb::service::IndexType::IT_IVF, vdb::NewFaissIVFIndex(opts.dim, opts.metric, opts.ivf_opts));
+    if (opts.ivfpq_m > 0 && opts.dim % opts.ivfpq_m == 0) {
+      IVFOptions ivfpq_opts = opts.ivf_opts;
+      ivfpq_opts.pq_m = opts.ivfpq_m;
+      index_factory_.Add(vdb::service::IndexType::IT_IVFPQ, vdb::NewFaissIVFIndex(opts.dim, opts.metric, ivfpq_opts));
+    } else {
+      LOG(WARNING) << "Skip IVFPQ index, dim=" << opts.dim << ",ivfpq_m=" << opts.ivfpq_m << ".";
+    }
     return true;
   }
 
+  // WAL 追加与应用在写锁内完成，等待落盘在锁外，这样并发的写请求可以合并为一次 fsync
   bool Upsert(const UpsertOptions& opts) {
-    auto index = index_factory_.GetIndex(opts.index_type);
-    if (!index) {
-      LOG(WARNING) << "Failed to get index type=" << opts.index_type << ".";
-      return false;
-    }
-
-    std::string scalar_value;
-    auto ec = persistence_.Get(std::to_string(opts.id), &scalar_value);
-    if (ec == KVStorage::EC_Undefined) {
-      LOG(WARNING) << "Failed to get scalar value from storage, id=" << opts.id << ".";
+    if (!ValidateUpsert(opts)) {
       return false;
     }
-    if (ec == KVStorage::EC_OK) {
-      // 先删除
-      index->Remove({opts.id});
+    uint64_t seq = 0;
+    {
+      std::lock_guard lock(write_mutex_);
+      if (!WriteUpserts(&opts, {opts.scalar_data}, &seq)) {
+        return false;
+      }
     }
+    return persistence_.SyncWALLog(seq);
+  }
 
-    if (opts.field && !opts.field->empty()) {
-      if (ec == KVStorage::EC_NotFound) {
-        for (const auto& [field_name, value] : *opts.field) {
-          field_bitmap_.UpdateFiledValue(opts.id, field_name, value);
-        }
-      } else {
-        // TODO(cong): 需要反序列化，不是很优雅
-        service::UpsertRequest request;
-        if (!request.ParseFromString(scalar_value)) {
-          LOG(WARNING) << "Failed to parse scalar data.";
-          return false;
-        }
-        for (const auto& [field_name, value] : *opts.field) {
-          auto it = request.fields().find(field_name);
-          if (it == request.fields().end()) {
-            field_bitmap_.UpdateFiledValue(opts.id, field_name, value);
-          } else {
-            field_bitmap_.UpdateFiledValue(opts.id, field_name, value, it->second);
-          }
-        }
+  bool UpsertBatch(const std::vector<UpsertOptions>& opts) {
+    if (opts.empty()) {
+      return true;
+    }
+    // 整批校验通过才写 WAL，任一条无效时整批拒绝
+    std::vector<std::string_view> datas;
+    datas.reserve(opts.size());
+    for (const auto& o : opts) {
+      if (!ValidateUpsert(o)) {
+        return false;
       }
+      datas.emplace_back(o.scalar_data);
     }
 
-    if (!persistence_.Put(std::to_string(opts.id), opts.scalar_data)) {
-      return false;
+    uint64_t seq = 0;
+    {
+      std::lock_guard lock(write_mutex_);
+      if (!WriteUpserts(opts.data(), datas, &seq)) {
+        return false;
+      }
     }
-
-    Index::InsertOptions insert_opts;
-    insert_opts.label = opts.id;
-    insert_opts.data = opts.data;
-    index->Insert(insert_opts);
-    return true;
+    return persistence_.SyncWALLog(seq);
   }
 
   bool Search(const SearchOptions& opts, SearchResult* res) {
@@ -90,19 +162,44 @@ class Database::Impl {
       LOG(WARNING) << "Failed to get index type=" << opts.index_type << ".";
       return false;
     }
+    if (opts.size == 0 || opts.size % dim_ != 0) {
+      LOG(WARNING) << "Invalid query size, size=" << opts.size << ",dim=" << dim_ << ".";
+      return false;
+    }
 
+    bool rerank = NeedRerank(opts.index_type) && opts.k > 0;
+    // 精排前每个查询保留的候选数
+    int num_candidates = rerank ? opts.k * rerank_factor_ : opts.k;
     Index::SearchOptions search_opts;
     search_opts.query = opts.query;
     search_opts.size = opts.size;
-    search_opts.k = opts.k;
+    search_opts.k = num_candidates;
+    search_opts.ef_search = opts.ef_search;
+    search_opts.adaptive_ef = opts.adaptive_ef;
+    search_opts.nprobe = opts.nprobe;
     roaring_bitmap_ptr ptr;
-    if (!opts.filter_op.empty()) {
-      FieldBitmap::Operation op =
-          (opts.filter_op == "=") ? FieldBitmap::Operation::EQUAL : FieldBitmap::Operation::NOT_EQUAL;
-      ptr = field_bitmap_.GetBitmap(opts.filter_field, opts.filter_value, op);
-      search_opts.bitmap = ptr.get();
+    res->filter_plan.clear();
+    res->filter_cache_hit.reset();
+    if (opts.filter) {
+      FilterCache::Status cache_status;
+      if (!filter_cache_.Evaluate(field_bitmap_, *opts.filter, &ptr, &cache_status)) {
+        LOG(WARNING) << "Failed to evaluate filter.";
+        return false;
+      }
+      if (cache_status != FilterCache::Status::UNCACHED) {
+        res->filter_cache_hit = cache_status == FilterCache::Status::HIT;
+      }
+      PlanFilter(index, opts, ptr.get(), &search_opts);
+      res->filter_plan = FilterPlanToString(search_opts.filter_plan);
     }
     auto s_res = index->Search(search_opts);
+    if (search_opts.filter_plan == FilterPlan::POST_FILTER) {
+      PostFilter(index, ptr.get(), opts.size / dim_, search_opts.k, num_candidates, &s_res);
+    }
+    id_map_.ToExternal(&s_res.indices);
+    if (rerank) {
+      return Rerank(index, opts, num_candidates, s_res, res);
+    }
     res->distances = std::move(s_res.distances);
     res->indices = std::move(s_res.indices);
     return true;
@@ -113,52 +210,574 @@ class Database::Impl {
     return ec == KVStorage::EC_OK || ec == KVStorage::EC_NotFound;
   }
 
+  // 流水线回放：读线程顺序读取 WAL，线程池并行解码，当前线程按日志顺序逐批应用，保证同一 id 后写覆盖先写
   bool Reload() {
+    std::lock_guard lock(write_mutex_);
     LOG(INFO) << "Start to reloading database.";
-    if (!persistence_.LoadSnapshot(&index_factory_, &field_bitmap_)) {
+    if (!LoadSnapshotLocked()) {
       LOG(WARNING) << "Failed to load snapshot.";
       return false;
     }
 
-    WAL_TYPE wt;
-    std::string data;
-    auto st = persistence_.ReadNextWALLog((char*)&wt, &data);
+    ThreadPool decode_pool(replay_threads_);
+    BlockingQueue<PendingReplayBatch> queue(decode_pool.Size() * 2);
+    std::atomic<bool> read_ok{true};
+    std::thread reader([&] {
+      auto batch = std::make_shared<ReplayBatch>();
+      auto submit = [&] {
+        PendingReplayBatch pending;
+        pending.batch = std::move(batch);
+        pending.decoded = decode_pool.Submit([b = pending.batch] { return DecodeReplayBatch(b.get()); });
+        batch = std::make_shared<ReplayBatch>();
+        batch->reserve(REPLAY_BATCH_SIZE);
+        return queue.Push(std::move(pending));
+      };
+
+      batch->reserve(REPLAY_BATCH_SIZE);
+      while (true) {
+        ReplayRecord record;
+        auto st = persistence_.ReadNextWALLog((char*)&record.wt, &record.version, &record.data);
+        if (st == Persistence::LS_END) {
+          break;
+        }
+        if (st == Persistence::LS_ERROR) {
+          LOG(WARNING) << "Failed to read WAL log.";
+          read_ok = false;
+          break;
+        }
+        batch->push_back(std::move(record));
+        if (batch->size() >= REPLAY_BATCH_SIZE && !submit()) {
+          break;
+        }
+      }
+      if (!batch->empty()) {
+        (void)submit();
+      }
+      queue.Close();
+    });
 
-    while (st != Persistence::LS_END) {
-      if (st == Persistence::LS_ERROR) {
-        LOG(WARNING) << "Failed to read WAL log.";
+    bool ok = true;
+    size_t num_records = 0;
+    auto start = std::chrono::steady_clock::now();
+    PendingReplayBatch pending;
+    while (queue.Pop(&pending)) {
+      if (!pending.decoded.get()) {
+        ok = false;
+        break;
+      }
+      if (!ApplyReplayBatch(pending.batch.get())) {
+        ok = false;
+        break;
+      }
+      size_t last_num_records = num_records;
+      num_records += pending.batch->size();
+      if (num_records / REPLAY_PROGRESS_INTERVAL != last_num_records / REPLAY_PROGRESS_INTERVAL) {
+        LOG(INFO) << "Reloading database, replayed_records=" << num_records
+                  << ",records_per_sec=" << RecordsPerSecond(num_records, start) << ".";
+      }
+    }
+    queue.Close();
+    reader.join();
+
+    if (!ok || !read_ok) {
+      LOG(WARNING) << "Failed to replay WAL log, replayed_records=" << num_records << ".";
+      return false;
+    }
+    LOG(INFO) << "Finish to reloading database, replayed_records=" << num_records
+              << ",records_per_sec=" << RecordsPerSecond(num_records, start) << ".";
+    return true;
+  }
+
+  bool WriteWALLog(WAL_TYPE wt, const std::string& data) {
+    std::lock_guard lock(write_mutex_);
+    return persistence_.WriteWALLog((char)wt, data);
+  }
+
+  // 在后台线程执行，已有 snapshot 在运行时直接返回
+  bool SaveSnapshot() {
+    std::lock_guard lock(snapshot_mutex_);
+    if (snapshot_running_) {
+      LOG(INFO) << "Snapshot is already running.";
+      return true;
+    }
+    if (snapshot_thread_.joinable()) {
+      snapshot_thread_.join();
+    }
+    snapshot_running_ = true;
+    snapshot_thread_ = std::thread([this] {
+      if (!DoSnapshot()) {
+        LOG(WARNING) << "Failed to save snapshot.";
+      }
+      snapshot_running_ = false;
+    });
+    return true;
+  }
+
+  bool LoadSnapshot() {
+    std::lock_guard lock(write_mutex_);
+    return LoadSnapshotLocked();
+  }
+
+  void GetSnapshotStats(SnapshotStats* stats) {
+    Persistence::WALStats wal_stats;
+    persistence_.GetWALStats(&wal_stats);
+    stats->wal_records = wal_stats.records;
+    stats->wal_bytes = wal_stats.bytes;
+    stats->seconds_since_snapshot = wal_stats.seconds_since_snapshot;
+    stats->running = snapshot_running_;
+  }
+
+ private:
+  // 写锁内只记录 snapshot 点，序列化、写文件与发布都在锁外，写请求照常进行。
+  // 回放从 snapshot 点开始，对 snapshot 中已包含的写入重复应用是幂等的
+  bool DoSnapshot() {
+    uint64_t snapshot_id = 0;
+    {
+      std::lock_guard lock(write_mutex_);
+      persistence_.BeginSnapshot(&snapshot_id);
+    }
+    return persistence_.CommitSnapshot(snapshot_id, index_factory_, field_bitmap_, id_map_);
+  }
+
+  // 需持有写锁
+  bool LoadSnapshotLocked() {
+    bool rebuild = false;
+    if (!persistence_.LoadSnapshot(&index_factory_, &field_bitmap_, &id_map_, &rebuild)) {
+      return false;
+    }
+    return !rebuild || RebuildFromStorage();
+  }
+
+  // 旧 snapshot 的索引与位图使用外部 id，无法直接加载：按 KV 中每个 id 的最新数据分配内部 id 并重新插入，
+  // 之后的 WAL 回放照常在此基础上应用
+  bool RebuildFromStorage() {
+    LOG(INFO) << "Start to rebuilding indexes from storage.";
+    auto start = std::chrono::steady_clock::now();
+    size_t num_records = 0;
+    std::vector<service::UpsertRequest> requests;
+    requests.reserve(REPLAY_BATCH_SIZE);
+    auto flush = [&] {
+      num_records += requests.size();
+      bool ok = InsertRequests(requests);
+      requests.clear();
+      return ok;
+    };
+    bool ok = persistence_.Scan([&](std::string_view key, std::string_view value) {
+      if (!requests.emplace_back().ParseFromArray(value.data(), (int)value.size())) {
+        LOG(WARNING) << "Failed to parse scalar data, key=" << key << ".";
         return false;
       }
+      return requests.size() < REPLAY_BATCH_SIZE || flush();
+    });
+    if (!ok || !flush()) {
+      LOG(WARNING) << "Failed to rebuild indexes from storage, records=" << num_records << ".";
+      return false;
+    }
+    LOG(INFO) << "Finish to rebuilding indexes from storage, records=" << num_records
+              << ",records_per_sec=" << RecordsPerSecond(num_records, start) << ".";
+    return true;
+  }
 
-      LOG(INFO) << "Operation Type:" << WT_2_STRING[wt];
-      if (wt == WT_UPSERT) {
-        service::UpsertRequest req;
-        if (auto st = JsonStrToPb(data, &req); !st.ok()) {
-          LOG(WARNING) << "Failed to parse data.";
-          return false;
+  // `requests` 中的 id 互不相同且都不在索引与位图中
+  bool InsertRequests(const std::vector<service::UpsertRequest>& requests) {
+    IndexInserts inserts;
+    for (const auto& req : requests) {
+      auto index_type = (service::IndexType)req.index_type();
+      if (!ValidateRecord(req.id(), index_type, req.vector_size())) {
+        LOG(WARNING) << "Skip invalid record, id=" << req.id() << ".";
+        continue;
+      }
+      auto index = index_factory_.GetIndex(index_type);
+      uint32_t internal_id = 0;
+      if (!id_map_.GetOrAssign(req.id(), &internal_id)) {
+        return false;
+      }
+      UpdateFieldBitmap(internal_id, &req.fields(), &req.typed_fields());
+      auto& [labels, data] = inserts[index];
+      labels.push_back(internal_id);
+      data.insert(data.end(), req.vector().begin(), req.vector().end());
+    }
+    InsertAll(inserts);
+    return true;
+  }
+
+  struct ReplayRecord {
+    WAL_TYPE wt{WT_NONE};
+    uint8_t version{0};
+    std::string data;
+    service::UpsertRequest req;
+  };
+  using ReplayBatch = std::vector<ReplayRecord>;
+
+  struct PendingReplayBatch {
+    std::shared_ptr<ReplayBatch> batch;
+    std::future<bool> decoded;
+  };
+
+  // 同一索引的向量拷贝到连续内存，一次插入；label 为内部 id
+  using IndexInserts = std::unordered_map<Index*, std::pair<std::vector<int64_t>, std::vector<float>>>;
+
+  static bool DecodeUpsertRecord(uint8_t version, const std::string& data, service::UpsertRequest* req) {
+    if (version == WAL_VERSION_JSON) {
+      return JsonStrToPb(data, req).ok();
+    }
+    if (version == WAL_VERSION_PB) {
+      return req->ParseFromString(data);
+    }
+    return false;
+  }
+
+  // 解码后 `data` 统一为 protobuf 二进制，可直接作为标量数据写入 KV
+  static bool DecodeReplayBatch(ReplayBatch* batch) {
+    for (auto& record : *batch) {
+      if (record.wt != WT_UPSERT) {
+        continue;
+      }
+      if (!DecodeUpsertRecord(record.version, record.data, &record.req)) {
+        LOG(WARNING) << "Skip undecodable WAL record, version=" << (int32_t)record.version << ".";
+        record.wt = WT_NONE;
+        continue;
+      }
+      if (record.version != WAL_VERSION_PB) {
+        record.data = record.req.SerializeAsString();
+      }
+    }
+    return true;
+  }
+
+  bool ApplyReplayBatch(ReplayBatch* batch) {
+    std::vector<UpsertOptions> upserts;
+    upserts.reserve(batch->size());
+    for (auto& record : *batch) {
+      VLOG(1) << "Operation Type:" << WT_2_STRING[record.wt];
+      if (record.wt != WT_UPSERT) {
+        continue;
+      }
+      Database::UpsertOptions opts;
+      opts.id = record.req.id();
+      opts.index_type = (service::IndexType)record.req.index_type();
+      opts.data = record.req.vector().data();
+      opts.size = record.req.vector_size();
+      opts.scalar_data = std::move(record.data);
+      opts.field = record.req.mutable_fields();
+      opts.typed_field = record.req.mutable_typed_fields();
+      // 旧版本在应用前写入 WAL，可能留下无法应用的记录（如索引类型不存在、维度不符），跳过而不是中断回放
+      if (!ValidateUpsert(opts)) {
+        LOG(WARNING) << "Skip invalid WAL record, id=" << opts.id << ".";
+        continue;
+      }
+      upserts.push_back(std::move(opts));
+    }
+    if (!ApplyUpsertBatch(upserts.data(), upserts.size(), true)) {
+      LOG(WARNING) << "Failed to upsert.";
+      return false;
+    }
+    return true;
+  }
+
+  // 按过滤位图的选择性选择执行方式并填好 `search_opts`：极稀疏时只对命中的 id 精确计算（FLAT/HNSW）；
+  // 很稠密时不带过滤条件多取一些结果再筛选；其余在索引中边搜索边过滤，HNSW 按选择性放大 ef 以保证召回
+  void PlanFilter(Index* index, const SearchOptions& opts, const roaring_bitmap_t* bitmap,
+                  Index::SearchOptions* search_opts) const {
+    size_t size = index->Size();
+    uint64_t cardinality = roaring_bitmap_get_cardinality(bitmap);
+    // 位图覆盖所有索引中的 id，命中数可能超过本索引的向量数
+    double selectivity = size > 0 ? std::min(1.0, (double)cardinality / size) : 1.0;
+    bool exact = opts.index_type == service::IndexType::IT_FLAT || opts.index_type == service::IndexType::IT_HNSW;
+
+    search_opts->bitmap = bitmap;
+    if (exact && selectivity <= PRE_FILTER_SELECTIVITY) {
+      search_opts->filter_plan = FilterPlan::PRE_FILTER;
+    } else if (selectivity >= POST_FILTER_SELECTIVITY) {
+      search_opts->filter_plan = FilterPlan::POST_FILTER;
+      search_opts->bitmap = nullptr;
+      auto k = (size_t)std::ceil(search_opts->k * POST_FILTER_OVERSAMPLE / selectivity);
+      search_opts->k = (int)std::max<size_t>(std::min(k, size), search_opts->k);
+    } else {
+      search_opts->filter_plan = FilterPlan::IN_FILTER;
+      if (opts.index_type == service::IndexType::IT_HNSW) {
+        int ef = opts.ef_search > 0 ? opts.ef_search : hnsw_ef_search_;
+        search_opts->ef_search = (int)std::min<double>(MAX_FILTERED_EF_SEARCH, std::ceil(ef / selectivity));
+      }
+    }
+    VLOG(1) << "Planned filtered search, plan=" << FilterPlanToString(search_opts->filter_plan)
+            << ",cardinality=" << cardinality << ",size=" << size << ",k=" << search_opts->k
+            << ",ef_search=" << search_opts->ef_search << ".";
+  }
+
+  // 每个查询的 `width` 个结果中只保留位图命中的，按原顺序前移并截断为 `k` 个，不足时以 -1 补齐
+  static void PostFilter(Index* index, const roaring_bitmap_t* bitmap, size_t num_queries, int width, int k,
+                         Index::SearchResult* res) {
+    float padding = index->IsSimilarity() ? std::numeric_limits<float>::lowest() : std::numeric_limits<float>::max();
+    std::vector<int64_t> indices(num_queries * k, -1);
+    std::vector<float> distances(num_queries * k, padding);
+    for (size_t q = 0; q < num_queries; ++q) {
+      int n = 0;
+      for (int i = 0; i < width && n < k; ++i) {
+        int64_t id = res->indices[q * width + i];
+        if (id >= 0 && roaring_bitmap_contains(bitmap, (uint32_t)id)) {
+          indices[q * k + n] = id;
+          distances[q * k + n] = res->distances[q * width + i];
+          ++n;
+        }
+      }
+    }
+    res->indices = std::move(indices);
+    res->distances = std::move(distances);
+  }
+
+  bool NeedRerank(service::IndexType index_type) const {
+    if (rerank_factor_ <= 0) {
+      return false;
+    }
+    if (index_type == service::IndexType::IT_IVFPQ) {
+      return true;
+    }
+    return storage_ != StorageType::FP32 &&
+           (index_type == service::IndexType::IT_FLAT || index_type == service::IndexType::IT_HNSW);
+  }
+
+  // 每个查询有 `num_candidates` 个候选，一次 `MultiGet` 取回全部候选的 fp32 原始向量，
+  // 按 `Index::Distance` 重新计算距离后取前 `k` 个；取不到原始向量的候选（已被并发覆盖/删除）丢弃
+  bool Rerank(Index* index, const SearchOptions& opts, int num_candidates, const Index::SearchResult& candidates,
+              SearchResult* res) {
+    size_t num_queries = opts.size / dim_;
+    std::vector<std::string> keys;
+    keys.reserve(candidates.indices.size());
+    for (auto id : candidates.indices) {
+      if (id >= 0) {
+        keys.push_back(std::to_string(id));
+      }
+    }
+    std::vector<std::string> values;
+    std::vector<KVStorage::ErrorCode> ecs;
+    persistence_.MultiGet(keys, &values, &ecs);
+
+    bool similarity = index->IsSimilarity();
+    float padding = similarity ? std::numeric_limits<float>::lowest() : std::numeric_limits<float>::max();
+    res->indices.assign(num_queries * opts.k, -1);
+    res->distances.assign(num_queries * opts.k, padding);
+    service::UpsertRequest request;
+    std::vector<std::pair<float, int64_t>> scored;
+    size_t key_pos = 0;
+    for (size_t q = 0; q < num_queries; ++q) {
+      scored.clear();
+      const float* query = opts.query + q * dim_;
+      for (int i = 0; i < num_candidates; ++i) {
+        int64_t id = candidates.indices[q * num_candidates + i];
+        if (id < 0) {
+          continue;
         }
-        Database::UpsertOptions opts;
-        opts.id = req.id();
-        opts.index_type = (service::IndexType)req.index_type();
-        opts.data = req.vector().data();
-        opts.scalar_data = req.SerializeAsString();
-        opts.field = req.mutable_fields();
-        if (!Upsert(opts)) {
-          LOG(WARNING) << "Failed to upsert.";
+        size_t pos = key_pos++;
+        if (ecs[pos] == KVStorage::EC_Undefined) {
+          LOG(WARNING) << "Failed to get scalar value from storage, id=" << id << ".";
           return false;
         }
+        if (ecs[pos] != KVStorage::EC_OK || !request.ParseFromString(values[pos]) ||
+            request.vector_size() != dim_) {
+          continue;
+        }
+        scored.emplace_back(index->Distance(query, request.vector().data()), id);
       }
-      st = persistence_.ReadNextWALLog((char*)&wt, &data);
+
+      size_t num_results = std::min<size_t>(scored.size(), opts.k);
+      auto cmp = [similarity](const auto& a, const auto& b) {
+        return similarity ? a.first > b.first : a.first < b.first;
+      };
+      std::partial_sort(scored.begin(), scored.begin() + num_results, scored.end(), cmp);
+      for (size_t i = 0; i < num_results; ++i) {
+        res->distances[q * opts.k + i] = scored[i].first;
+        res->indices[q * opts.k + i] = scored[i].second;
+      }
+    }
+    return true;
+  }
+
+  static int64_t RecordsPerSecond(size_t num_records, std::chrono::steady_clock::time_point start) {
+    auto elapsed_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    return (int64_t)num_records * 1000 / std::max<int64_t>(elapsed_ms, 1);
+  }
+
+  // id 0 表示请求未设置，-1 与搜索结果的补位冲突
+  bool ValidateRecord(int64_t id, service::IndexType index_type, size_t size) const {
+    if (id == 0 || id == -1 || size != (size_t)dim_ || !index_factory_.GetIndex(index_type)) {
+      LOG(WARNING) << "Invalid record, id=" << id << ",index_type=" << index_type << ",size=" << size
+                   << ",dim=" << dim_ << ".";
+      return false;
     }
-    LOG(INFO) << "Finish to reloading database.";
     return true;
   }
 
-  bool WriteWALLog(WAL_TYPE wt, const std::string& data) { return persistence_.WriteWALLog((char)wt, data); }
+  // 写 WAL 之前调用，保证写入 WAL 的记录在回放时一定能应用
+  bool ValidateUpsert(const UpsertOptions& opts) const {
+    return opts.data && ValidateRecord(opts.id, opts.index_type, opts.size);
+  }
+
+  // 一批写入在修改索引与位图前准备好的信息，批内 id 互不相同
+  struct PreparedUpserts {
+    std::vector<const UpsertOptions*> opts;
+    std::vector<Index*> indexes;
+    std::vector<uint32_t> internal_ids;
+    std::unordered_map<Index*, std::vector<int64_t>> removed_ids;
+  };
 
-  bool SaveSnapshot() { return persistence_.SaveSnapshot(&index_factory_, &field_bitmap_); }
+  // 需持有写锁。可能失败的步骤（分配内部 id、读旧数据、写 KV）都在追加 WAL 之前完成，失败时 WAL 中不会留下
+  // 未生效的记录。追加只在 WAL 写线程已出错或停止时失败，此时 KV 已写入，仍应用到索引与位图使其与 KV 一致，
+  // 与追加成功但落盘失败的情况相同
+  bool WriteUpserts(const UpsertOptions* opts, const std::vector<std::string_view>& datas, uint64_t* seq) {
+    PreparedUpserts prepared;
+    if (!PrepareUpsertBatch(opts, datas.size(), false, &prepared)) {
+      return false;
+    }
+    bool appended = persistence_.AppendWALLogBatch(WT_UPSERT, datas, seq);
+    if (!appended) {
+      LOG(WARNING) << "Failed to write wal log.";
+    }
+    ApplyPrepared(prepared);
+    return appended;
+  }
 
-  bool LoadSnapshot() { return persistence_.LoadSnapshot(&index_factory_, &field_bitmap_); }
+  bool ApplyUpsertBatch(const UpsertOptions* opts, size_t n, bool replay) {
+    PreparedUpserts prepared;
+    if (!PrepareUpsertBatch(opts, n, replay, &prepared)) {
+      return false;
+    }
+    ApplyPrepared(prepared);
+    return true;
+  }
+
+  // 批内同一 id 只应用最后一次写入，KV 与索引的结果与逐条应用一致。记录需已通过 `ValidateUpsert`
+  bool PrepareUpsertBatch(const UpsertOptions* opts, size_t n, bool replay, PreparedUpserts* prepared) {
+    std::unordered_map<int64_t, size_t> last;
+    last.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      last[opts[i].id] = i;
+    }
+    prepared->opts.reserve(last.size());
+    for (size_t i = 0; i < n; ++i) {
+      if (last[opts[i].id] == i) {
+        prepared->opts.push_back(opts + i);
+      }
+    }
+    return PrepareUniqueUpserts(replay, prepared);
+  }
+
+  // 读旧数据并写 KV，成功后 `ApplyPrepared` 不会失败，失败时索引与位图都未修改。
+  // 回放时 KV 中的记录可能比 snapshot 中的索引新，据此找不到 id 实际所在的索引，因此从所有索引中删除
+  bool PrepareUniqueUpserts(bool replay, PreparedUpserts* prepared) {
+    const auto& opts = prepared->opts;
+    size_t n = opts.size();
+    if (n == 0) {
+      return true;
+    }
+    auto& indexes = prepared->indexes;
+    auto& internal_ids = prepared->internal_ids;
+    auto& removed_ids = prepared->removed_ids;
+    indexes.resize(n);
+    internal_ids.resize(n);
+    std::vector<std::string> keys(n);
+    for (size_t i = 0; i < n; ++i) {
+      indexes[i] = index_factory_.GetIndex(opts[i]->index_type);
+      if (!id_map_.GetOrAssign(opts[i]->id, &internal_ids[i])) {
+        return false;
+      }
+      keys[i] = std::to_string(opts[i]->id);
+    }
+
+    std::vector<std::string> scalar_values;
+    std::vector<KVStorage::ErrorCode> ecs;
+    persistence_.MultiGet(keys, &scalar_values, &ecs);
+    // 旧记录所在的索引可能与本次不同，按旧记录的索引类型删除
+    service::UpsertRequest old_request;
+    for (size_t i = 0; i < n; ++i) {
+      if (ecs[i] == KVStorage::EC_Undefined) {
+        LOG(WARNING) << "Failed to get scalar value from storage, id=" << opts[i]->id << ".";
+        return false;
+      }
+      if (ecs[i] != KVStorage::EC_OK) {
+        continue;
+      }
+      // TODO(cong): 需要反序列化，不是很优雅
+      if (!old_request.ParseFromString(scalar_values[i])) {
+        // 旧数据损坏时不知道它所在的索引，只从本次的索引中删除，不影响新数据写入
+        LOG(WARNING) << "Failed to parse scalar data, id=" << opts[i]->id << ".";
+        removed_ids[indexes[i]].push_back(internal_ids[i]);
+        continue;
+      }
+      auto old_index = index_factory_.GetIndex((service::IndexType)old_request.index_type());
+      removed_ids[old_index ? old_index : indexes[i]].push_back(internal_ids[i]);
+    }
+    if (replay) {
+      removed_ids.clear();
+      for (auto* index : index_factory_.GetIndexes()) {
+        removed_ids[index].assign(internal_ids.begin(), internal_ids.end());
+      }
+    }
+
+    std::vector<std::pair<std::string, std::string_view>> kvs;
+    kvs.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      kvs.emplace_back(std::move(keys[i]), opts[i]->scalar_data);
+    }
+    return persistence_.PutBatch(kvs);
+  }
+
+  void ApplyPrepared(const PreparedUpserts& prepared) {
+    // 先删除
+    for (const auto& [index, ids] : prepared.removed_ids) {
+      index->Remove(ids);
+    }
+
+    size_t n = prepared.opts.size();
+    for (size_t i = 0; i < n; ++i) {
+      UpdateFieldBitmap(prepared.internal_ids[i], prepared.opts[i]->field, prepared.opts[i]->typed_field);
+    }
+
+    IndexInserts inserts;
+    for (size_t i = 0; i < n; ++i) {
+      auto& [labels, data] = inserts[prepared.indexes[i]];
+      labels.push_back(prepared.internal_ids[i]);
+      data.insert(data.end(), prepared.opts[i]->data, prepared.opts[i]->data + dim_);
+    }
+    InsertAll(inserts);
+  }
+
+  static void InsertAll(const IndexInserts& inserts) {
+    for (const auto& [index, insert] : inserts) {
+      Index::InsertBatchOptions insert_opts;
+      insert_opts.data = insert.second.data();
+      insert_opts.labels = insert.first.data();
+      insert_opts.n = insert.first.size();
+      index->InsertBatch(insert_opts);
+    }
+  }
+
+  // 与 `fields` 同名的 `typed_fields` 优先
+  void UpdateFieldBitmap(uint32_t internal_id, const FieldMap* fields, const TypedFieldMap* typed_fields) {
+    if (fields) {
+      service::FieldValue value;
+      for (const auto& [field_name, int_value] : *fields) {
+        if (typed_fields && typed_fields->count(field_name)) {
+          continue;
+        }
+        value.set_int_value(int_value);
+        UpdateField(internal_id, field_name, value);
+      }
+    }
+    if (typed_fields) {
+      for (const auto& [field_name, value] : *typed_fields) {
+        UpdateField(internal_id, field_name, value);
+      }
+    }
+  }
+
+  // 类型与字段不符的值不进入位图，该 id 在此字段上的旧值随之清除，数据仍然写入
+  void UpdateField(uint32_t internal_id, const std::string& field_name, const service::FieldValue& value) {
+    if (!field_bitmap_.UpdateFiledValue(internal_id, field_name, value)) {
+      LOG(WARNING) << "Skip field filter, id=" << internal_id << ",field=" << field_name << ".";
+    }
+  }
 };
 
 /************************************************************************/
@@ -172,6 +791,8 @@ bool Database::Init(const InitOptions& opts) { return impl_->Init(opts); }
 
 bool Database::Upsert(const UpsertOptions& opts) { return impl_->Upsert(opts); }
 
+bool Database::UpsertBatch(const std::vector<UpsertOptions>& opts) { return impl_->UpsertBatch(opts); }
+
 bool Database::Search(const SearchOptions& opts, SearchResult* res) { return impl_->Search(opts, res); }
 
 bool Database::Query(int64_t id, std::string* data) { return impl_->Query(id, data); }
@@ -184,4 +805,6 @@ bool Database::SaveSnapshot() { return impl_->SaveSnapshot(); }
 
 bool Database::LoadSnapshot() { return impl_->LoadSnapshot(); }
 
+void Database::GetSnapshotStats(SnapshotStats* stats) { impl_->GetSnapshotStats(stats); }
+
 }  // namespace vdb
@@ -5,20 +5,54 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
+#include "index/index.h"
+#include "persistence/wal.h"
 
 namespace vdb {
 
 /************************************************************************/
 /* Database */
 /************************************************************************/
+// 线程安全：搜索/查询可并发执行；`Upsert` 先校验，再写 WAL 并应用，写请求之间串行。
 class Database {
+ public:
+  using FieldMap = ::google::protobuf::Map<std::string, ::google::protobuf::int64>;
+  using TypedFieldMap = ::google::protobuf::Map<std::string, service::FieldValue>;
+
  public:
   struct InitOptions {
     std::string persistence_path;
     int dim = 1;
+    // 所有索引使用同一度量
+    MetricType metric{MetricType::L2};
+    // FLAT 与 HNSW 索引中向量的存储精度
+    StorageType storage{StorageType::FP32};
+    // 大于 0 时，压缩存储的索引（含 IVF-PQ）先取 `k * rerank_factor` 个候选，再用 KV 中的 fp32 原始向量精排
+    int rerank_factor{0};
+    // FLAT 墓碑占比超过该值时后台重建，0 表示不重建
+    double flat_compact_ratio{0.3};
+    // SQ8 的 FLAT 索引增长到上次训练时的该倍数且有向量超出训练范围时重新训练，不大于 1 表示不重新训练
+    double flat_retrain_growth{4.0};
+    // HNSW 的初始容量，写满后按 `hnsw_growth_factor` 自动扩容
     int num_data = 1000;
+    double hnsw_growth_factor{2.0};
+    // HNSW 墓碑占比超过该值时后台重建，0 表示不重建
+    double hnsw_compact_ratio{0.3};
+    // HNSW 请求未指定 ef_search 时的默认值
+    int hnsw_ef_search{50};
+    IVFOptions ivf_opts;
+    // IVF-PQ 的子量化器数，`dim` 不能被整除时不创建 IT_IVFPQ
+    size_t ivfpq_m{8};
+    WALWriter::SyncPolicy wal_sync_policy{WALWriter::SP_PER_REQUEST};
+    int wal_sync_interval_ms{10};
+    size_t wal_segment_size{64 << 20};
+    // WAL 回放的解码线程数，0 表示使用 CPU 核数
+    int replay_threads{0};
+    // 过滤位图缓存的内存上限，0 表示不缓存
+    size_t filter_cache_bytes{64 << 20};
   };
 
  public:
@@ -26,24 +60,45 @@ class Database {
     int64_t id{-1};
     service::IndexType index_type{service::IndexType::IT_INVALID};
     const float* data{nullptr};
+    // `data` 中的浮点数个数，需等于维度
+    size_t size{0};
+    // `UpsertRequest` 的 protobuf 二进制，同时作为 WAL 记录体与 KV 中的标量数据
     std::string scalar_data;
-    // TODO(cong): 不够灵活
-    const ::google::protobuf::Map<std::string, ::google::protobuf::int64>* field{nullptr};
+    const FieldMap* field{nullptr};
+    const TypedFieldMap* typed_field{nullptr};
   };
 
+  // `query` 可包含多个查询向量，`size` 需为维度的整数倍
   struct SearchOptions {
     service::IndexType index_type{service::IndexType::IT_INVALID};
     const float* query{nullptr};
     size_t size{0};
     int k{0};
-    std::string filter_field;
-    std::string filter_op;
-    int64_t filter_value{0};
+    // 0 表示使用索引的默认值
+    int ef_search{0};
+    bool adaptive_ef{false};
+    int nprobe{0};
+    // 为空时不过滤
+    const service::FilterExpression* filter{nullptr};
   };
 
+  // 每个查询占 `k` 个位置，无结果处的 id 为 -1
   struct SearchResult {
     std::vector<int64_t> indices;
     std::vector<float> distances;
+    // 带过滤条件时选择的执行方式，见 `FilterPlanToString`；否则为空
+    std::string filter_plan;
+    // 过滤位图是否命中缓存，未经过缓存时为空
+    std::optional<bool> filter_cache_hit;
+  };
+
+ public:
+  struct SnapshotStats {
+    // 上次 snapshot 之后新增的 WAL
+    uint64_t wal_records{0};
+    uint64_t wal_bytes{0};
+    int64_t seconds_since_snapshot{0};
+    bool running{false};
   };
 
  public:
@@ -77,14 +132,18 @@ class Database {
 
  public:
   [[nodiscard]] bool Upsert(const UpsertOptions& opts);
+  // 整批写入同一组 WAL、一次 RocksDB `WriteBatch`，并按索引批量插入；批内同一 id 后写覆盖先写；任一条无效时整批拒绝
+  [[nodiscard]] bool UpsertBatch(const std::vector<UpsertOptions>& opts);
   [[nodiscard]] bool Search(const SearchOptions& opts, SearchResult* res);
   [[nodiscard]] bool Query(int64_t id, std::string* data);
 
  public:
   [[nodiscard]] bool Reload();
   [[nodiscard]] bool WriteWALLog(WAL_TYPE wt, const std::string& data);
+  // 异步执行，返回 true 表示 snapshot 已在后台开始（或已有一个正在运行）
   [[nodiscard]] bool SaveSnapshot();
   [[nodiscard]] bool LoadSnapshot();
+  void GetSnapshotStats(SnapshotStats* stats);
 };
 
 }  // namespace vdb
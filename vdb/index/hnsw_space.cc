@@ -0,0 +1,251 @@
+#include "index/hnsw_space.h"
+#include <faiss/utils/fp16.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace vdb {
+
+namespace {
+
+/**
+ *
+ * Format of each SQ8 vector:
+ * ----------------------------------------------------------------------------
+ * | Min (4) | Scale (4) | Codes (dim) |
+ * ----------------------------------------------------------------------------
+ *
+ * 每个向量单独量化：x[i] ≈ Min + Scale * Codes[i]，无需训练。
+ *
+ */
+struct SQ8Header {
+  float min{0};
+  float scale{0};
+};
+
+// 不依赖 F16C 指令的 fp16 解码。乘 2^112 同时修正指数偏置并处理非规格化数，Inf/NaN 用掩码补齐指数，
+// 全程无分支，下面的循环可被编译器向量化
+inline float HalfToFloat(uint16_t h) {
+  const uint32_t magic_bits = (254u - 15u) << 23;
+  const uint32_t inf_nan_bits = (127u + 16u) << 23;
+  float magic;
+  float inf_nan;
+  std::memcpy(&magic, &magic_bits, 4);
+  std::memcpy(&inf_nan, &inf_nan_bits, 4);
+
+  uint32_t bits = (uint32_t)(h & 0x7fff) << 13;
+  float f;
+  std::memcpy(&f, &bits, 4);
+  f *= magic;
+  std::memcpy(&bits, &f, 4);
+  bits |= (0u - (uint32_t)(f >= inf_nan)) & (255u << 23);
+  bits |= (uint32_t)(h & 0x8000) << 16;
+  std::memcpy(&f, &bits, 4);
+  return f;
+}
+
+// 分 `FP16_LANES` 路独立累加，浮点加法的顺序固定，不依赖 -ffast-math 也能向量化
+const size_t FP16_LANES = 16;
+
+template <typename Term>
+float SumLanes(size_t dim, const Term& term) {
+  float acc[FP16_LANES] = {};
+  size_t i = 0;
+  for (; i + FP16_LANES <= dim; i += FP16_LANES) {
+    for (size_t j = 0; j < FP16_LANES; ++j) {
+      acc[j] += term(i + j);
+    }
+  }
+  float sum = 0;
+  for (; i < dim; ++i) {
+    sum += term(i);
+  }
+  for (float a : acc) {
+    sum += a;
+  }
+  return sum;
+}
+
+float FP16L2Sqr(const void* x, const void* y, const void* param) {
+  size_t dim = *(const size_t*)param;
+  auto* a = (const uint16_t*)x;
+  auto* b = (const uint16_t*)y;
+  return SumLanes(dim, [a, b](size_t i) {
+    float d = HalfToFloat(a[i]) - HalfToFloat(b[i]);
+    return d * d;
+  });
+}
+
+float FP16InnerProductDistance(const void* x, const void* y, const void* param) {
+  size_t dim = *(const size_t*)param;
+  auto* a = (const uint16_t*)x;
+  auto* b = (const uint16_t*)y;
+  return 1.0f - SumLanes(dim, [a, b](size_t i) { return HalfToFloat(a[i]) * HalfToFloat(b[i]); });
+}
+
+// 码值的整数和。x = min + scale * code，距离可展开为这些和的线性组合，循环内只有整数运算
+struct SQ8Sums {
+  uint64_t a{0};
+  uint64_t b{0};
+  uint64_t aa{0};
+  uint64_t bb{0};
+  uint64_t ab{0};
+};
+
+// 块内用 uint32 累加，255 * 255 * SQ8_BLOCK 不超过 2^32
+const size_t SQ8_BLOCK = 65536;
+
+template <bool SQUARES>
+SQ8Sums SumCodes(const uint8_t* a, const uint8_t* b, size_t dim) {
+  SQ8Sums sums;
+  for (size_t begin = 0; begin < dim; begin += SQ8_BLOCK) {
+    size_t end = std::min(dim, begin + SQ8_BLOCK);
+    uint32_t sa = 0;
+    uint32_t sb = 0;
+    uint32_t saa = 0;
+    uint32_t sbb = 0;
+    uint32_t sab = 0;
+    for (size_t i = begin; i < end; ++i) {
+      uint32_t ai = a[i];
+      uint32_t bi = b[i];
+      sa += ai;
+      sb += bi;
+      sab += ai * bi;
+      if constexpr (SQUARES) {
+        saa += ai * ai;
+        sbb += bi * bi;
+      }
+    }
+    sums.a += sa;
+    sums.b += sb;
+    sums.aa += saa;
+    sums.bb += sbb;
+    sums.ab += sab;
+  }
+  return sums;
+}
+
+// 展开式在 double 下合并，抵消误差远小于 SQ8 的量化误差
+float SQ8L2Sqr(const void* x, const void* y, const void* param) {
+  size_t dim = *(const size_t*)param;
+  SQ8Header ha;
+  SQ8Header hb;
+  std::memcpy(&ha, x, sizeof(SQ8Header));
+  std::memcpy(&hb, y, sizeof(SQ8Header));
+  auto sums = SumCodes<true>((const uint8_t*)x + sizeof(SQ8Header), (const uint8_t*)y + sizeof(SQ8Header), dim);
+  // sum((bias + sa * a - sb * b)^2)
+  double bias = (double)ha.min - hb.min;
+  double sa = ha.scale;
+  double sb = hb.scale;
+  double sum = dim * bias * bias + sa * sa * sums.aa + sb * sb * sums.bb + 2 * bias * sa * sums.a -
+               2 * bias * sb * sums.b - 2 * sa * sb * sums.ab;
+  return (float)std::max(sum, 0.0);
+}
+
+float SQ8InnerProductDistance(const void* x, const void* y, const void* param) {
+  size_t dim = *(const size_t*)param;
+  SQ8Header ha;
+  SQ8Header hb;
+  std::memcpy(&ha, x, sizeof(SQ8Header));
+  std::memcpy(&hb, y, sizeof(SQ8Header));
+  auto sums = SumCodes<false>((const uint8_t*)x + sizeof(SQ8Header), (const uint8_t*)y + sizeof(SQ8Header), dim);
+  // sum((ma + sa * a) * (mb + sb * b))
+  double ma = ha.min;
+  double mb = hb.min;
+  double sa = ha.scale;
+  double sb = hb.scale;
+  double sum = dim * ma * mb + ma * sb * sums.b + mb * sa * sums.a + sa * sb * sums.ab;
+  return 1.0f - (float)sum;
+}
+
+void EncodeSQ8(const float* x, size_t dim, char* out) {
+  SQ8Header header;
+  float max = 0;
+  if (dim > 0) {
+    auto [min_it, max_it] = std::minmax_element(x, x + dim);
+    header.min = *min_it;
+    max = *max_it;
+  }
+  header.scale = (max - header.min) / 255.0f;
+  std::memcpy(out, &header, sizeof(SQ8Header));
+  auto* codes = (uint8_t*)out + sizeof(SQ8Header);
+  for (size_t i = 0; i < dim; ++i) {
+    float code = header.scale > 0 ? std::round((x[i] - header.min) / header.scale) : 0.0f;
+    codes[i] = (uint8_t)std::clamp(code, 0.0f, 255.0f);
+  }
+}
+
+/************************************************************************/
+/* QuantizedSpace */
+/************************************************************************/
+class QuantizedSpace : public hnswlib::SpaceInterface<float> {
+ private:
+  size_t dim_{0};
+  size_t data_size_{0};
+  hnswlib::DISTFUNC<float> dist_func_{nullptr};
+
+ public:
+  QuantizedSpace(StorageType storage, MetricType metric, size_t dim) {
+    dim_ = dim;
+    data_size_ = EncodedSize(storage, dim);
+    bool l2 = metric == MetricType::L2;
+    if (storage == StorageType::FP16) {
+      dist_func_ = l2 ? FP16L2Sqr : FP16InnerProductDistance;
+    } else if (storage == StorageType::SQ8) {
+      dist_func_ = l2 ? SQ8L2Sqr : SQ8InnerProductDistance;
+    } else {
+      throw std::runtime_error("Invalid storage type.");
+    }
+  }
+  ~QuantizedSpace() override = default;
+
+ public:
+  size_t get_data_size() override { return data_size_; }
+  hnswlib::DISTFUNC<float> get_dist_func() override { return dist_func_; }
+  void* get_dist_func_param() override { return &dim_; }
+};
+
+}  // namespace
+
+/************************************************************************/
+/* Vector codec */
+/************************************************************************/
+size_t EncodedSize(StorageType storage, size_t dim) {
+  switch (storage) {
+    case StorageType::FP16:
+      return dim * sizeof(uint16_t);
+    case StorageType::SQ8:
+      return sizeof(SQ8Header) + dim;
+    default:
+      return dim * sizeof(float);
+  }
+}
+
+void EncodeVectors(StorageType storage, const float* data, size_t dim, size_t n, char* out) {
+  size_t code_size = EncodedSize(storage, dim);
+  for (size_t i = 0; i < n; ++i) {
+    const float* x = data + i * dim;
+    char* code = out + i * code_size;
+    if (storage == StorageType::FP16) {
+      auto* h = (uint16_t*)code;
+      for (size_t j = 0; j < dim; ++j) {
+        h[j] = faiss::encode_fp16(x[j]);
+      }
+    } else if (storage == StorageType::SQ8) {
+      EncodeSQ8(x, dim, code);
+    } else {
+      std::memcpy(code, x, code_size);
+    }
+  }
+}
+
+/************************************************************************/
+/* Quantized space */
+/************************************************************************/
+std::unique_ptr<hnswlib::SpaceInterface<float>> NewQuantizedSpace(StorageType storage, MetricType metric, size_t dim) {
+  return std::make_unique<QuantizedSpace>(storage, metric, dim);
+}
+
+}  // namespace vdb
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <hnswlib/hnswlib.h>
+#include <stddef.h>
+#include <memory>
+#include "index/index.h"
+
+namespace vdb {
+
+/************************************************************************/
+/* Vector codec */
+/************************************************************************/
+// 单个向量编码后的字节数
+size_t EncodedSize(StorageType storage, size_t dim);
+// 将 `n` 个连续存放的向量编码到 `out`，`out` 需有 `n * EncodedSize(storage, dim)` 字节
+void EncodeVectors(StorageType storage, const float* data, size_t dim, size_t n, char* out);
+
+/************************************************************************/
+/* Quantized space */
+/************************************************************************/
+// 存储 fp16 或逐向量 SQ8 编码的 hnswlib space，距离直接在编码上计算；查询需以同样方式编码。
+// 距离口径与 hnswlib 自带的 space 一致：L2 为平方距离，IP/COSINE 为 1 - 内积。
+std::unique_ptr<hnswlib::SpaceInterface<float>> NewQuantizedSpace(StorageType storage, MetricType metric, size_t dim);
+
+}  // namespace vdb
@@ -0,0 +1,101 @@
+#include "index/id_map.h"
+#include <glog/logging.h>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+namespace vdb {
+
+/************************************************************************/
+/* IdMap */
+/************************************************************************/
+bool IdMap::GetOrAssign(int64_t external_id, uint32_t* internal_id) {
+  std::unique_lock lock(mutex_);
+  auto it = internal_ids_.find(external_id);
+  if (it != internal_ids_.end()) {
+    *internal_id = it->second;
+    return true;
+  }
+  if (external_ids_.size() >= std::numeric_limits<uint32_t>::max()) {
+    LOG(WARNING) << "Failed to assign internal id, id=" << external_id << ",size=" << external_ids_.size() << ".";
+    return false;
+  }
+  *internal_id = (uint32_t)external_ids_.size();
+  internal_ids_.emplace(external_id, *internal_id);
+  external_ids_.push_back(external_id);
+  return true;
+}
+
+bool IdMap::Find(int64_t external_id, uint32_t* internal_id) const {
+  std::shared_lock lock(mutex_);
+  auto it = internal_ids_.find(external_id);
+  if (it == internal_ids_.end()) {
+    return false;
+  }
+  *internal_id = it->second;
+  return true;
+}
+
+void IdMap::ToExternal(std::vector<int64_t>* ids) const {
+  std::shared_lock lock(mutex_);
+  for (auto& id : *ids) {
+    if (id >= 0 && (size_t)id < external_ids_.size()) {
+      id = external_ids_[id];
+    } else if (id >= 0) {
+      LOG(WARNING) << "Unknown internal id=" << id << ".";
+      id = -1;
+    }
+  }
+}
+
+size_t IdMap::Size() const {
+  std::shared_lock lock(mutex_);
+  return external_ids_.size();
+}
+
+void IdMap::Clear() {
+  std::unique_lock lock(mutex_);
+  internal_ids_.clear();
+  external_ids_.clear();
+}
+
+/**
+ *
+ * Format:
+ * ----------------------------------------------------------------------------
+ * | Count (8) | ExternalID (8) * Count |
+ * ----------------------------------------------------------------------------
+ *
+ * 第 i 个外部 id 的内部 id 为 i
+ *
+ */
+std::string IdMap::SerializeToString() const {
+  std::shared_lock lock(mutex_);
+  uint64_t count = external_ids_.size();
+  std::string data(8 + count * 8, '\0');
+  std::memcpy(data.data(), &count, 8);
+  std::memcpy(data.data() + 8, external_ids_.data(), count * 8);
+  return data;
+}
+
+bool IdMap::ParseFromString(const std::string& data) {
+  uint64_t count = 0;
+  if (data.size() >= 8) {
+    std::memcpy(&count, data.data(), 8);
+  }
+  if (data.size() < 8 || count > std::numeric_limits<uint32_t>::max() || data.size() != 8 + count * 8) {
+    LOG(WARNING) << "Invalid id map, size=" << data.size() << ".";
+    return false;
+  }
+  std::unique_lock lock(mutex_);
+  external_ids_.resize(count);
+  std::memcpy(external_ids_.data(), data.data() + 8, count * 8);
+  internal_ids_.clear();
+  internal_ids_.reserve(count);
+  for (uint64_t i = 0; i < count; ++i) {
+    internal_ids_.emplace(external_ids_[i], (uint32_t)i);
+  }
+  return true;
+}
+
+}  // namespace vdb
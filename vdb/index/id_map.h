@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vdb {
+
+/************************************************************************/
+/* IdMap */
+/************************************************************************/
+// 外部 id（任意 int64）到稠密 32 位内部 id 的映射。索引的 label 与过滤位图都只使用内部 id，
+// 这样位图容器保持紧凑，且不受外部 id 取值分布的影响。内部 id 按首次出现的顺序从 0 分配，不回收。
+class IdMap {
+ private:
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<int64_t, uint32_t> internal_ids_;
+  // 下标为内部 id
+  std::vector<int64_t> external_ids_;
+
+ public:
+  // 不存在时分配下一个内部 id，内部 id 用尽时返回 false
+  [[nodiscard]] bool GetOrAssign(int64_t external_id, uint32_t* internal_id);
+  [[nodiscard]] bool Find(int64_t external_id, uint32_t* internal_id) const;
+  // 原地把内部 id 换成外部 id，-1 保持不变
+  void ToExternal(std::vector<int64_t>* ids) const;
+  [[nodiscard]] size_t Size() const;
+  void Clear();
+
+ public:
+  [[nodiscard]] std::string SerializeToString() const;
+  [[nodiscard]] bool ParseFromString(const std::string& data);
+};
+
+}  // namespace vdb
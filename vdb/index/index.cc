@@ -1,18 +1,122 @@
 #include "index/index.h"
 #include <faiss/Index.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexFlatCodes.h>
 #include <faiss/IndexIDMap.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexScalarQuantizer.h>
 #include <faiss/MetricType.h>
+#include <faiss/impl/DistanceComputer.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/impl/io.h>
 #include <faiss/index_io.h>
+#include <faiss/invlists/DirectMap.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+#include <glog/logging.h>
 #include <hnswlib/hnswlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fstream>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "index/hnsw_space.h"
+#include "util/thread_pool.h"
 
 namespace vdb {
 
 namespace {
 
+// 批量插入 HNSW 时每个线程至少分到的向量数，批量过小时并行得不偿失
+const size_t MIN_PARALLEL_INSERT_SIZE = 256;
+// HNSW 重建时每次持有共享锁拷出的槽位数
+const size_t COMPACT_CHUNK_SIZE = 4096;
+// 自适应 ef 重试时的上限
+const size_t MAX_ADAPTIVE_EF_SEARCH = 4096;
+// Faiss 建议每个聚类中心至少 39 个训练点
+const size_t IVF_MIN_POINTS_PER_CENTROID = 39;
+// Faiss SQ8 攒够多少个向量后训练各维度的取值范围，之前以 fp32 暴力搜索
+const size_t SQ8_TRAIN_SIZE = 16384;
+// Faiss 平坦索引墓碑文件的后缀
+const std::string TOMBSTONE_FILE_SUFFIX = ".deleted";
+
+// COSINE 需要归一化时拷贝到 `buffer` 中批量归一化，否则直接返回 `data`
+const float* Normalize(MetricType metric, const float* data, size_t dim, size_t n, std::vector<float>* buffer) {
+  if (metric != MetricType::COSINE) {
+    return data;
+  }
+  buffer->assign(data, data + dim * n);
+  faiss::fvec_renorm_L2(dim, n, buffer->data());
+  return buffer->data();
+}
+
+// fp32 精确距离。`similarity` 为 true 时 IP/COSINE 返回内积，否则返回 1 - 内积
+float ExactDistance(MetricType metric, const float* x, const float* y, size_t dim, bool similarity) {
+  if (metric == MetricType::L2) {
+    return faiss::fvec_L2sqr(x, y, dim);
+  }
+  float ip = faiss::fvec_inner_product(x, y, dim);
+  if (metric == MetricType::COSINE) {
+    float norm = std::sqrt(faiss::fvec_norm_L2sqr(x, dim) * faiss::fvec_norm_L2sqr(y, dim));
+    ip = norm > 0 ? ip / norm : 0;
+  }
+  return similarity ? ip : 1.0f - ip;
+}
+
+// 只计算 `offsets` 处向量的距离，边算边维护大小为 `k` 的堆；结果由近到远，不足 `k` 个时以 -1 补齐。
+// `C` 为 `CMax` 时距离越小越近（L2），为 `CMin` 时越大越近（内积）
+template <typename C>
+void FilteredTopK(faiss::FlatCodesDistanceComputer* dc, const std::vector<faiss::idx_t>& offsets, int k,
+                  float* distances, faiss::idx_t* labels) {
+  faiss::heap_heapify<C>(k, distances, labels);
+  auto push = [&](float dist, faiss::idx_t offset) {
+    if (C::cmp(distances[0], dist)) {
+      faiss::heap_replace_top<C>(k, distances, labels, dist, offset);
+    }
+  };
+  size_t i = 0;
+  // 每次算 4 个，Faiss 的批量接口可以交错访存
+  for (; i + 4 <= offsets.size(); i += 4) {
+    float d0, d1, d2, d3;
+    dc->distances_batch_4(offsets[i], offsets[i + 1], offsets[i + 2], offsets[i + 3], d0, d1, d2, d3);
+    push(d0, offsets[i]);
+    push(d1, offsets[i + 1]);
+    push(d2, offsets[i + 2]);
+    push(d3, offsets[i + 3]);
+  }
+  for (; i < offsets.size(); ++i) {
+    push((*dc)(offsets[i]), offsets[i]);
+  }
+  faiss::heap_reorder<C>(k, distances, labels);
+}
+
+// Faiss 索引序列化到内存，格式与 `write_index` 写文件相同
+std::string WriteFaissIndex(const faiss::Index* index) {
+  faiss::VectorIOWriter writer;
+  faiss::write_index(index, &writer);
+  return std::string(writer.data.begin(), writer.data.end());
+}
+
+// 后台重建索引期间记录的写操作，换入新索引前按顺序重放
+struct PendingIndexOp {
+  bool remove{false};
+  int64_t label{-1};
+  std::vector<float> data;
+};
+
 /************************************************************************/
 /* RoaringBitmap class */
 /************************************************************************/
@@ -25,12 +129,33 @@ class FaissRoaringBitmapIDSelector : public faiss::IDSelector {
   ~FaissRoaringBitmapIDSelector() override = default;
 
  public:
+  // label 为 `IdMap` 分配的 32 位内部 id
   bool is_member(int64_t id) const final {
-    // 只支持 32 位？
     return roaring_bitmap_contains(bitmap_, (uint32_t)id);
   }
 };
 
+// 按内层索引的偏移过滤：跳过墓碑，再经 `ids` 映射回 id 检查过滤位图
+class FaissTombstoneIDSelector : public faiss::IDSelector {
+ private:
+  const roaring_bitmap_t* deleted_{nullptr};
+  const roaring_bitmap_t* bitmap_{nullptr};
+  const faiss::idx_t* ids_{nullptr};
+
+ public:
+  FaissTombstoneIDSelector(const roaring_bitmap_t* deleted, const roaring_bitmap_t* bitmap, const faiss::idx_t* ids)
+      : deleted_(deleted), bitmap_(bitmap), ids_(ids) {}
+  ~FaissTombstoneIDSelector() override = default;
+
+ public:
+  bool is_member(int64_t offset) const final {
+    if (roaring_bitmap_contains(deleted_, (uint32_t)offset)) {
+      return false;
+    }
+    return !bitmap_ || roaring_bitmap_contains(bitmap_, (uint32_t)ids_[offset]);
+  }
+};
+
 class HNSWRoaringBitmapIDFilter : public hnswlib::BaseFilterFunctor {
  private:
   const roaring_bitmap_t* bitmap_{nullptr};
@@ -48,50 +173,579 @@ class HNSWRoaringBitmapIDFilter : public hnswlib::BaseFilterFunctor {
 /************************************************************************/
 /* FaissIndex */
 /************************************************************************/
+// FP16 直接使用 `IndexScalarQuantizer(QT_fp16)`；SQ8 需要先训练各维度的取值范围，
+// 攒够 `SQ8_TRAIN_SIZE` 个向量前写入 `IndexFlat`，之后在后台训练并整体转换为 `QT_8bit`；
+// 之后存活向量数增长到上次训练时的 `retrain_growth` 倍且写入过超出训练范围的向量时在后台重新训练。
+// 删除只按偏移打墓碑，搜索时直接查内层索引并跳过墓碑；墓碑比例超过阈值时在后台重建，
+// 训练与重建期间的写操作记录在 `pending_ops_` 中，换入新索引前按顺序重放。
 class FaissIndex : public Index {
  private:
-  std::unique_ptr<faiss::Index> index_;
+  // 内层为 `IndexFlatCodes`（`IndexFlat` 或 `IndexScalarQuantizer`），偏移即 `id_map` 的下标
+  struct Store {
+    std::unique_ptr<faiss::IndexIDMap> index;
+    std::shared_ptr<roaring_bitmap_t> deleted;
+    // 存活 id 到偏移
+    std::unordered_map<int64_t, faiss::idx_t> offsets;
+  };
+
+  int dim_{0};
+  MetricType metric_{MetricType::L2};
+  FlatOptions opts_;
+  // 搜索共享，插入/删除独占
+  mutable std::shared_mutex mutex_;
+  Store store_;
+
+  // 以下成员由 `mutex_` 保护
+  // SQ8 仍为 fp32 缓冲区时为 false
+  bool quantized_{true};
+  // SQ8 上次训练后的存活向量数
+  size_t trained_size_{0};
+  // SQ8 写入过的向量与上次训练所用的各维度范围，前 `dim_` 个为最小值，后 `dim_` 个为最大值
+  std::vector<float> observed_bounds_;
+  std::vector<float> trained_bounds_;
+  bool rebuilding_{false};
+  std::vector<PendingIndexOp> pending_ops_;
+  // `Load` 后递增，重建中途发现变化则放弃
+  uint64_t epoch_{0};
+  std::atomic<bool> stopped_{false};
+  std::thread rebuild_thread_;
 
  public:
-  FaissIndex(int dim, MetricType metric) {
-    faiss::MetricType faiss_metric = (metric == MetricType::L2) ? faiss::METRIC_L2 : faiss::METRIC_INNER_PRODUCT;
-    index_ = std::make_unique<faiss::IndexIDMap>(new faiss::IndexFlat(dim, faiss_metric));
+  FaissIndex(int dim, MetricType metric, const FlatOptions& opts) {
+    dim_ = dim;
+    metric_ = metric;
+    opts_ = opts;
+    faiss::Index* index = nullptr;
+    if (opts.storage == StorageType::FP16) {
+      index = new faiss::IndexScalarQuantizer(dim, faiss::ScalarQuantizer::QT_fp16, FaissMetric());
+    } else {
+      index = new faiss::IndexFlat(dim, FaissMetric());
+      quantized_ = opts.storage == StorageType::FP32;
+    }
+    store_.index = NewIDMap(index);
+    store_.deleted = NewBitmap();
+  }
+
+  ~FaissIndex() override {
+    stopped_ = true;
+    if (rebuild_thread_.joinable()) {
+      rebuild_thread_.join();
+    }
   }
-  ~FaissIndex() override = default;
 
  public:
   void Insert(const InsertOptions& opts) override {
-    auto id = (faiss::idx_t)opts.label;
-    index_->add_with_ids(1, opts.data, &id);
+    InsertBatchOptions batch_opts;
+    batch_opts.data = opts.data;
+    batch_opts.labels = &opts.label;
+    batch_opts.n = 1;
+    InsertBatch(batch_opts);
+  }
+
+  void InsertBatch(const InsertBatchOptions& opts) override {
+    std::vector<float> buffer;
+    const float* data = Normalize(metric_, opts.data, dim_, opts.n, &buffer);
+    // 各维度范围在锁外统计，锁内只合并
+    std::vector<float> bounds;
+    if (opts_.storage == StorageType::SQ8) {
+      bounds = Bounds(data, opts.n);
+    }
+    std::unique_lock lock(mutex_);
+    Add(&store_, data, opts.labels, opts.n);
+    if (rebuilding_) {
+      for (size_t i = 0; i < opts.n; ++i) {
+        pending_ops_.push_back({false, opts.labels[i], std::vector<float>(data + i * dim_, data + (i + 1) * dim_)});
+      }
+    }
+    MergeBounds(bounds, &observed_bounds_);
+    MaybeRebuild();
   }
 
   SearchResult Search(const SearchOptions& opts) override {
-    int dim = index_->d;
-    int num_queries = opts.size / dim;
+    std::shared_lock lock(mutex_);
+    int num_queries = opts.size / dim_;
+    std::vector<float> buffer;
+    const float* query = Normalize(metric_, opts.query, dim_, num_queries, &buffer);
     std::vector<faiss::idx_t> indices(num_queries * opts.k);
     std::vector<float> distances(num_queries * opts.k);
 
-    if (opts.bitmap) {
+    faiss::Index* inner = store_.index->index;
+    const faiss::idx_t* ids = store_.index->id_map.data();
+    std::vector<faiss::idx_t> offsets;
+    if (opts.bitmap && opts.filter_plan == FilterPlan::PRE_FILTER) {
+      CollectFiltered(opts.bitmap, &offsets);
+      SearchFiltered(query, num_queries, opts.k, offsets, distances.data(), indices.data());
+    } else if (opts.bitmap || !roaring_bitmap_is_empty(store_.deleted.get())) {
       faiss::SearchParameters search_params;
-      FaissRoaringBitmapIDSelector selector(opts.bitmap);
+      FaissTombstoneIDSelector selector(store_.deleted.get(), opts.bitmap, ids);
       search_params.sel = &selector;
-      index_->search(num_queries, opts.query, opts.k, distances.data(), indices.data(), &search_params);
+      inner->search(num_queries, query, opts.k, distances.data(), indices.data(), &search_params);
     } else {
-      index_->search(num_queries, opts.query, opts.k, distances.data(), indices.data());
+      inner->search(num_queries, query, opts.k, distances.data(), indices.data());
+    }
+    for (auto& index : indices) {
+      if (index >= 0) {
+        index = ids[index];
+      }
     }
     return {indices, distances};
   }
 
   void Remove(const std::vector<int64_t>& ids) override {
-    auto* id_map = (faiss::IndexIDMap*)(index_.get());
-    if (id_map) {
-      faiss::IDSelectorBatch selector(ids.size(), ids.data());
-      id_map->remove_ids(selector);
+    std::unique_lock lock(mutex_);
+    for (auto id : ids) {
+      Delete(&store_, id);
+      if (rebuilding_) {
+        pending_ops_.push_back({true, id, {}});
+      }
+    }
+    MaybeRebuild();
+  }
+
+  // 墓碑单独保存为 `<name>.deleted`，没有墓碑时不写
+  bool Serialize(const std::string& name, IndexFiles* files) override {
+    std::shared_lock lock(mutex_);
+    files->emplace_back(name, WriteFaissIndex(store_.index.get()));
+    const roaring_bitmap_t* deleted = store_.deleted.get();
+    if (roaring_bitmap_is_empty(deleted)) {
+      return true;
+    }
+    std::string data(roaring_bitmap_portable_size_in_bytes(deleted), '\0');
+    roaring_bitmap_portable_serialize(deleted, data.data());
+    files->emplace_back(name + TOMBSTONE_FILE_SUFFIX, std::move(data));
+    return true;
+  }
+
+  bool Load(const std::string& path) override {
+    std::ifstream file(path);
+    if (!file.good()) {
+      return true;
+    }
+    file.close();
+
+    Store store;
+    std::unique_ptr<faiss::Index> index(faiss::read_index(path.c_str()));
+    auto* id_map = dynamic_cast<faiss::IndexIDMap*>(index.get());
+    if (!id_map) {
+      LOG(WARNING) << "Failed to load Faiss index, not an IndexIDMap, path=" << path << ".";
+      return false;
+    }
+    index.release();
+    store.index.reset(id_map);
+    id_map->own_fields = true;
+
+    store.deleted = NewBitmap();
+    std::ifstream tombstone_file(path + TOMBSTONE_FILE_SUFFIX, std::ios::binary);
+    if (tombstone_file.good()) {
+      std::string data((std::istreambuf_iterator<char>(tombstone_file)), std::istreambuf_iterator<char>());
+      roaring_bitmap_t* deleted = roaring_bitmap_portable_deserialize_safe(data.data(), data.size());
+      if (!deleted) {
+        LOG(WARNING) << "Failed to parse Faiss index tombstones, path=" << path << ".";
+        return false;
+      }
+      store.deleted.reset(deleted, roaring_bitmap_free);
+    }
+    for (faiss::idx_t offset = 0; offset < id_map->ntotal; ++offset) {
+      if (!roaring_bitmap_contains(store.deleted.get(), (uint32_t)offset)) {
+        store.offsets[id_map->id_map[offset]] = offset;
+      }
+    }
+    auto* sq = dynamic_cast<const faiss::IndexScalarQuantizer*>(id_map->index);
+    std::vector<float> bounds;
+    if (opts_.storage == StorageType::SQ8) {
+      bounds = sq ? TrainedBounds(sq) : Bounds(((const faiss::IndexFlat*)id_map->index)->get_xb(), id_map->ntotal);
+    }
+
+    std::unique_lock lock(mutex_);
+    quantized_ = opts_.storage != StorageType::SQ8 || sq != nullptr;
+    trained_size_ = sq ? store.offsets.size() : 0;
+    trained_bounds_ = sq ? bounds : std::vector<float>();
+    observed_bounds_ = std::move(bounds);
+    store_ = std::move(store);
+    ++epoch_;
+    return true;
+  }
+
+  size_t Size() const override {
+    std::shared_lock lock(mutex_);
+    return store_.offsets.size();
+  }
+
+  float Distance(const float* x, const float* y) const override {
+    return ExactDistance(metric_, x, y, dim_, IsSimilarity());
+  }
+
+  bool IsSimilarity() const override { return metric_ != MetricType::L2; }
+
+ private:
+  faiss::MetricType FaissMetric() const {
+    return metric_ == MetricType::L2 ? faiss::METRIC_L2 : faiss::METRIC_INNER_PRODUCT;
+  }
+
+  // 需持有锁。按 id 查出过滤位图命中的存活偏移，升序排列便于顺序访存
+  void CollectFiltered(const roaring_bitmap_t* bitmap, std::vector<faiss::idx_t>* offsets) const {
+    std::vector<uint32_t> ids(roaring_bitmap_get_cardinality(bitmap));
+    roaring_bitmap_to_uint32_array(bitmap, ids.data());
+    offsets->reserve(ids.size());
+    for (auto id : ids) {
+      auto it = store_.offsets.find(id);
+      if (it != store_.offsets.end()) {
+        offsets->push_back(it->second);
+      }
+    }
+    std::sort(offsets->begin(), offsets->end());
+  }
+
+  // 需持有锁。距离计算复用 Faiss 对当前存储格式（fp32/fp16/SQ8）的 SIMD 实现，结果为偏移
+  void SearchFiltered(const float* query, size_t num_queries, int k, const std::vector<faiss::idx_t>& offsets,
+                      float* distances, faiss::idx_t* labels) const {
+    auto* inner = (const faiss::IndexFlatCodes*)store_.index->index;
+    std::unique_ptr<faiss::FlatCodesDistanceComputer> dc(inner->get_FlatCodesDistanceComputer());
+    for (size_t q = 0; q < num_queries; ++q) {
+      dc->set_query(query + q * dim_);
+      if (IsSimilarity()) {
+        FilteredTopK<faiss::CMin<float, faiss::idx_t>>(dc.get(), offsets, k, distances + q * k, labels + q * k);
+      } else {
+        FilteredTopK<faiss::CMax<float, faiss::idx_t>>(dc.get(), offsets, k, distances + q * k, labels + q * k);
+      }
+    }
+  }
+
+  static std::unique_ptr<faiss::IndexIDMap> NewIDMap(faiss::Index* index) {
+    auto id_map = std::make_unique<faiss::IndexIDMap>(index);
+    id_map->own_fields = true;
+    return id_map;
+  }
+
+  static std::shared_ptr<roaring_bitmap_t> NewBitmap() {
+    return std::shared_ptr<roaring_bitmap_t>(roaring_bitmap_create(), roaring_bitmap_free);
+  }
+
+  // 与 `index` 类型及训练参数相同的空索引
+  faiss::IndexFlatCodes* NewEmptyLike(const faiss::Index* index) const {
+    if (auto* sq = dynamic_cast<const faiss::IndexScalarQuantizer*>(index)) {
+      auto* empty = new faiss::IndexScalarQuantizer(dim_, sq->sq.qtype, FaissMetric());
+      empty->sq = sq->sq;
+      empty->is_trained = sq->is_trained;
+      return empty;
+    }
+    return new faiss::IndexFlat(dim_, FaissMetric());
+  }
+
+  // 已存在的 id 先打墓碑，保证每个 id 只有一个存活偏移
+  static void Add(Store* store, const float* data, const int64_t* ids, size_t n) {
+    static_assert(sizeof(faiss::idx_t) == sizeof(int64_t));
+    faiss::idx_t offset = store->index->ntotal;
+    for (size_t i = 0; i < n; ++i) {
+      Delete(store, ids[i]);
+      store->offsets[ids[i]] = offset + i;
+    }
+    store->index->add_with_ids((faiss::idx_t)n, data, (const faiss::idx_t*)ids);
+  }
+
+  static void Delete(Store* store, int64_t id) {
+    auto it = store->offsets.find(id);
+    if (it == store->offsets.end()) {
+      return;
+    }
+    roaring_bitmap_add(store->deleted.get(), (uint32_t)it->second);
+    store->offsets.erase(it);
+  }
+
+  // 直接追加已编码的向量，省去解码再编码
+  static void AppendCodes(Store* store, const std::vector<uint8_t>& codes, const std::vector<faiss::idx_t>& ids) {
+    auto* inner = (faiss::IndexFlatCodes*)store->index->index;
+    faiss::idx_t offset = store->index->ntotal;
+    inner->codes.insert(inner->codes.end(), codes.begin(), codes.end());
+    inner->ntotal += ids.size();
+    store->index->id_map.insert(store->index->id_map.end(), ids.begin(), ids.end());
+    store->index->ntotal += ids.size();
+    for (size_t i = 0; i < ids.size(); ++i) {
+      store->offsets[ids[i]] = offset + i;
+    }
+  }
+
+  // `n` 个向量各维度的范围，布局同 `observed_bounds_`
+  std::vector<float> Bounds(const float* data, size_t n) const {
+    if (n == 0) {
+      return {};
+    }
+    std::vector<float> bounds(data, data + dim_);
+    bounds.insert(bounds.end(), data, data + dim_);
+    for (size_t i = 1; i < n; ++i) {
+      const float* x = data + i * dim_;
+      for (int j = 0; j < dim_; ++j) {
+        bounds[j] = std::min(bounds[j], x[j]);
+        bounds[dim_ + j] = std::max(bounds[dim_ + j], x[j]);
+      }
+    }
+    return bounds;
+  }
+
+  void MergeBounds(const std::vector<float>& from, std::vector<float>* to) const {
+    if (from.empty()) {
+      return;
+    }
+    if (to->empty()) {
+      *to = from;
+      return;
+    }
+    for (int j = 0; j < dim_; ++j) {
+      (*to)[j] = std::min((*to)[j], from[j]);
+      (*to)[dim_ + j] = std::max((*to)[dim_ + j], from[dim_ + j]);
+    }
+  }
+
+  // `QT_8bit` 的训练结果前 `dim_` 个为最小值，后 `dim_` 个为范围宽度
+  std::vector<float> TrainedBounds(const faiss::IndexScalarQuantizer* sq) const {
+    const auto& trained = sq->sq.trained;
+    if (trained.size() != 2 * (size_t)dim_) {
+      return {};
+    }
+    std::vector<float> bounds(trained.begin(), trained.end());
+    for (int j = 0; j < dim_; ++j) {
+      bounds[dim_ + j] += bounds[j];
+    }
+    return bounds;
+  }
+
+  // 需持有锁
+  bool NeedTrain() const {
+    if (opts_.storage != StorageType::SQ8) {
+      return false;
+    }
+    if (!quantized_) {
+      return store_.index->ntotal >= (faiss::idx_t)SQ8_TRAIN_SIZE;
+    }
+    if (opts_.retrain_growth <= 1 || trained_bounds_.empty() ||
+        store_.offsets.size() < opts_.retrain_growth * std::max(trained_size_, SQ8_TRAIN_SIZE)) {
+      return false;
+    }
+    for (int j = 0; j < dim_; ++j) {
+      if (observed_bounds_[j] < trained_bounds_[j] || observed_bounds_[dim_ + j] > trained_bounds_[dim_ + j]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // 需持有锁
+  bool NeedCompact() const {
+    if (opts_.compact_ratio <= 0) {
+      return false;
+    }
+    size_t deleted = roaring_bitmap_get_cardinality(store_.deleted.get());
+    return deleted >= opts_.compact_min_deleted && deleted >= opts_.compact_ratio * store_.index->ntotal;
+  }
+
+  // 需持有独占锁
+  void MaybeRebuild() {
+    if (rebuilding_) {
+      return;
+    }
+    bool train = NeedTrain();
+    if (!train && !NeedCompact()) {
+      return;
+    }
+    if (rebuild_thread_.joinable()) {
+      rebuild_thread_.join();
+    }
+    LOG(INFO) << "Start to rebuilding Faiss index, train=" << train << ",elements=" << store_.index->ntotal
+              << ",deleted=" << roaring_bitmap_get_cardinality(store_.deleted.get()) << ".";
+    rebuilding_ = true;
+    rebuild_thread_ = std::thread([this, train] { Rebuild(train); });
+  }
+
+  // 分块在共享锁下拷出存活向量，块之间写请求可继续执行；最后在独占锁下重放期间的写操作并换入新索引。
+  // `train` 为 true 时按当前各维度范围训练 SQ8，拷出的向量解码后在锁外重新编码，否则直接拷贝编码。
+  // 之前已按旧范围截断的向量无法恢复，重新训练只让之后的向量不再被截断
+  void Rebuild(bool train) {
+    uint64_t epoch = 0;
+    faiss::idx_t num_elements = 0;
+    std::vector<float> bounds;
+    Store store;
+    {
+      std::shared_lock lock(mutex_);
+      epoch = epoch_;
+      num_elements = store_.index->ntotal;
+      if (train) {
+        bounds = observed_bounds_;
+        store.index = NewIDMap(new faiss::IndexScalarQuantizer(dim_, faiss::ScalarQuantizer::QT_8bit, FaissMetric()));
+      } else {
+        store.index = NewIDMap(NewEmptyLike(store_.index->index));
+      }
+      store.deleted = NewBitmap();
+    }
+    if (train) {
+      // 默认的 `RS_minmax` 只取样本各维度的最值，最小值与最大值两行即可训练
+      store.index->index->train(2, bounds.data());
+      store.index->is_trained = true;
+    }
+
+    std::vector<uint8_t> codes;
+    std::vector<float> data;
+    std::vector<faiss::idx_t> ids;
+    bool aborted = false;
+    for (faiss::idx_t begin = 0; begin < num_elements; begin += COMPACT_CHUNK_SIZE) {
+      codes.clear();
+      data.clear();
+      ids.clear();
+      {
+        std::shared_lock lock(mutex_);
+        if (stopped_ || epoch_ != epoch) {
+          aborted = true;
+          break;
+        }
+        auto* inner = (const faiss::IndexFlatCodes*)store_.index->index;
+        size_t code_size = inner->code_size;
+        faiss::idx_t end = std::min(begin + (faiss::idx_t)COMPACT_CHUNK_SIZE, num_elements);
+        for (faiss::idx_t offset = begin; offset < end; ++offset) {
+          if (roaring_bitmap_contains(store_.deleted.get(), (uint32_t)offset)) {
+            continue;
+          }
+          ids.push_back(store_.index->id_map[offset]);
+          if (train) {
+            data.resize(data.size() + dim_);
+            inner->reconstruct(offset, data.data() + data.size() - dim_);
+          } else {
+            const uint8_t* code = inner->codes.data() + offset * code_size;
+            codes.insert(codes.end(), code, code + code_size);
+          }
+        }
+      }
+      if (train) {
+        Add(&store, data.data(), ids.data(), ids.size());
+      } else {
+        AppendCodes(&store, codes, ids);
+      }
+    }
+
+    std::unique_lock lock(mutex_);
+    rebuilding_ = false;
+    if (aborted || stopped_ || epoch_ != epoch) {
+      pending_ops_.clear();
+      LOG(INFO) << "Abort rebuilding Faiss index.";
+      return;
+    }
+    for (const auto& op : pending_ops_) {
+      if (op.remove) {
+        Delete(&store, op.label);
+      } else {
+        Add(&store, op.data.data(), &op.label, 1);
+      }
+    }
+    LOG(INFO) << "Finish to rebuilding Faiss index, elements=" << store_.index->ntotal
+              << ",new_elements=" << store.index->ntotal << ",replayed_ops=" << pending_ops_.size() << ".";
+    pending_ops_.clear();
+    store_ = std::move(store);
+    if (train) {
+      quantized_ = true;
+      trained_size_ = store_.offsets.size();
+      trained_bounds_ = std::move(bounds);
+    }
+  }
+};
+
+/************************************************************************/
+/* FaissIVFIndex */
+/************************************************************************/
+// 训练前写入 `IndexIDMap(IndexFlat)` 缓冲区并暴力搜索，攒够 `train_size` 个向量后在后台训练 IVF；
+// 之后向量数增长到上次训练时的 `retrain_growth` 倍时在后台重新训练。
+// 训练期间写请求照常执行并记录到 `pending_ops_`，换入新索引前重放。
+class FaissIVFIndex : public Index {
+ private:
+  int dim_{0};
+  MetricType metric_{MetricType::L2};
+  IVFOptions opts_;
+  // 搜索共享，插入/删除独占
+  mutable std::shared_mutex mutex_;
+  std::unique_ptr<faiss::Index> index_;
+  // `index_` 已训练为 IVF 时指向它，否则为空
+  faiss::IndexIVF* ivf_{nullptr};
+
+  // 以下成员由 `mutex_` 保护
+  size_t trained_size_{0};
+  bool training_{false};
+  std::vector<PendingIndexOp> pending_ops_;
+  // `Load` 后递增，训练中途发现变化则放弃
+  uint64_t epoch_{0};
+  std::atomic<bool> stopped_{false};
+  std::thread train_thread_;
+
+ public:
+  FaissIVFIndex(int dim, MetricType metric, const IVFOptions& opts) {
+    dim_ = dim;
+    metric_ = metric;
+    opts_ = opts;
+    opts_.nlist = std::max<size_t>(opts.nlist, 1);
+    if (opts_.train_size == 0) {
+      opts_.train_size = IVF_MIN_POINTS_PER_CENTROID * opts_.nlist;
+    }
+    opts_.train_size = std::max(opts_.train_size, opts_.nlist);
+    index_ = std::make_unique<faiss::IndexIDMap>(new faiss::IndexFlat(dim, FaissMetric()));
+    ((faiss::IndexIDMap*)index_.get())->own_fields = true;
+  }
+
+  ~FaissIVFIndex() override {
+    stopped_ = true;
+    if (train_thread_.joinable()) {
+      train_thread_.join();
+    }
+  }
+
+ public:
+  void Insert(const InsertOptions& opts) override {
+    InsertBatchOptions batch_opts;
+    batch_opts.data = opts.data;
+    batch_opts.labels = &opts.label;
+    batch_opts.n = 1;
+    InsertBatch(batch_opts);
+  }
+
+  void InsertBatch(const InsertBatchOptions& opts) override {
+    std::vector<float> buffer;
+    const float* data = Normalize(metric_, opts.data, dim_, opts.n, &buffer);
+    std::unique_lock lock(mutex_);
+    index_->add_with_ids((faiss::idx_t)opts.n, data, (const faiss::idx_t*)opts.labels);
+    if (training_) {
+      for (size_t i = 0; i < opts.n; ++i) {
+        pending_ops_.push_back({false, opts.labels[i], std::vector<float>(data + i * dim_, data + (i + 1) * dim_)});
+      }
+    }
+    MaybeTrain();
+  }
+
+  SearchResult Search(const SearchOptions& opts) override {
+    size_t num_queries = opts.size / dim_;
+    std::vector<float> buffer;
+    const float* query = Normalize(metric_, opts.query, dim_, num_queries, &buffer);
+    std::vector<faiss::idx_t> indices(num_queries * opts.k);
+    std::vector<float> distances(num_queries * opts.k);
+
+    FaissRoaringBitmapIDSelector selector(opts.bitmap);
+    faiss::SearchParametersIVF search_params;
+    search_params.nprobe = opts.nprobe > 0 ? opts.nprobe : opts_.nprobe;
+    search_params.sel = opts.bitmap ? &selector : nullptr;
+
+    std::shared_lock lock(mutex_);
+    // 未训练时 `index_` 为 `IndexIDMap`，只使用 `sel`
+    index_->search(num_queries, query, opts.k, distances.data(), indices.data(), &search_params);
+    return {std::vector<int64_t>(indices.begin(), indices.end()), distances};
+  }
+
+  void Remove(const std::vector<int64_t>& ids) override {
+    std::unique_lock lock(mutex_);
+    RemoveIds(index_.get(), ivf_ != nullptr, ids.data(), ids.size());
+    if (training_) {
+      for (auto id : ids) {
+        pending_ops_.push_back({true, id, {}});
+      }
     }
   }
 
-  bool Save(const std::string& path) override {
-    faiss::write_index(index_.get(), path.c_str());
+  bool Serialize(const std::string& name, IndexFiles* files) override {
+    std::shared_lock lock(mutex_);
+    files->emplace_back(name, WriteFaissIndex(index_.get()));
     return true;
   }
 
@@ -99,11 +753,231 @@ class FaissIndex : public Index {
     std::ifstream file(path);
     if (file.good()) {
       file.close();
-      index_.reset(faiss::read_index(path.c_str()));
+      std::unique_ptr<faiss::Index> index(faiss::read_index(path.c_str()));
+      std::unique_lock lock(mutex_);
+      index_ = std::move(index);
+      ivf_ = dynamic_cast<faiss::IndexIVF*>(index_.get());
+      if (ivf_) {
+        ivf_->set_direct_map_type(faiss::DirectMap::Hashtable);
+      }
+      trained_size_ = ivf_ ? index_->ntotal : 0;
+      ++epoch_;
       return true;
     }
     return true;
   }
+
+  size_t Size() const override {
+    std::shared_lock lock(mutex_);
+    return index_->ntotal;
+  }
+
+  float Distance(const float* x, const float* y) const override {
+    return ExactDistance(metric_, x, y, dim_, IsSimilarity());
+  }
+
+  bool IsSimilarity() const override { return metric_ != MetricType::L2; }
+
+ private:
+  faiss::MetricType FaissMetric() const {
+    return metric_ == MetricType::L2 ? faiss::METRIC_L2 : faiss::METRIC_INNER_PRODUCT;
+  }
+
+  std::unique_ptr<faiss::IndexIVF> NewIVF() const {
+    auto* quantizer = new faiss::IndexFlat(dim_, FaissMetric());
+    std::unique_ptr<faiss::IndexIVF> ivf;
+    if (opts_.pq_m > 0) {
+      ivf = std::make_unique<faiss::IndexIVFPQ>(quantizer, dim_, opts_.nlist, opts_.pq_m, opts_.pq_nbits,
+                                                FaissMetric());
+    } else {
+      ivf = std::make_unique<faiss::IndexIVFFlat>(quantizer, dim_, opts_.nlist, FaissMetric());
+    }
+    ivf->own_fields = true;
+    // 按 id 删除与重建需要 id 到倒排位置的映射
+    ivf->set_direct_map_type(faiss::DirectMap::Hashtable);
+    return ivf;
+  }
+
+  // IVF 的哈希 direct map 只支持 `IDSelectorArray`；`IndexIDMap` 逐个判断成员，用 `IDSelectorBatch`
+  static void RemoveIds(faiss::Index* index, bool ivf, const int64_t* ids, size_t n) {
+    if (ivf) {
+      faiss::IDSelectorArray selector(n, (const faiss::idx_t*)ids);
+      index->remove_ids(selector);
+    } else {
+      faiss::IDSelectorBatch selector(n, (const faiss::idx_t*)ids);
+      index->remove_ids(selector);
+    }
+  }
+
+  // 需持有独占锁
+  void MaybeTrain() {
+    if (training_) {
+      return;
+    }
+    auto ntotal = (size_t)index_->ntotal;
+    bool need_train = !ivf_ && ntotal >= opts_.train_size;
+    bool need_retrain = ivf_ && opts_.retrain_growth > 1 &&
+                        ntotal >= opts_.retrain_growth * std::max(trained_size_, opts_.train_size);
+    if (!need_train && !need_retrain) {
+      return;
+    }
+    if (train_thread_.joinable()) {
+      train_thread_.join();
+    }
+    LOG(INFO) << "Start to training IVF index, ntotal=" << ntotal << ",trained_size=" << trained_size_ << ".";
+    training_ = true;
+    train_thread_ = std::thread([this] { Train(); });
+  }
+
+  void Train() {
+    auto ivf = NewIVF();
+    bool ok = false;
+    try {
+      ok = Rebuild(ivf.get());
+      if (ok) {
+        PurgeTouched(ivf.get());
+      }
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "Failed to train IVF index, error=" << e.what() << ".";
+    }
+
+    std::unique_lock lock(mutex_);
+    training_ = false;
+    if (!ok) {
+      pending_ops_.clear();
+      LOG(INFO) << "Abort training IVF index.";
+      return;
+    }
+    // 经 `PurgeTouched` 后新索引中每个 id 至多一份，插入前先删除，避免同一 id 出现两次
+    for (const auto& op : pending_ops_) {
+      RemoveIds(ivf.get(), true, &op.label, 1);
+      if (!op.remove) {
+        auto id = (faiss::idx_t)op.label;
+        ivf->add_with_ids(1, op.data.data(), &id);
+      }
+    }
+    LOG(INFO) << "Finish to training IVF index, ntotal=" << ivf->ntotal << ",replayed_ops=" << pending_ops_.size()
+              << ".";
+    pending_ops_.clear();
+    trained_size_ = ivf->ntotal;
+    ivf_ = ivf.get();
+    index_ = std::move(ivf);
+  }
+
+  // 训练新索引并填入当前所有向量；`Load` 或析构时返回 false
+  bool Rebuild(faiss::IndexIVF* ivf) {
+    uint64_t epoch = 0;
+    std::vector<faiss::idx_t> ids;
+    std::vector<float> data;
+    {
+      std::shared_lock lock(mutex_);
+      epoch = epoch_;
+      if (!ivf_) {
+        // 缓冲区大小约为 `train_size`，一次拷出
+        auto* id_map = (faiss::IndexIDMap*)index_.get();
+        auto* flat = (faiss::IndexFlat*)id_map->index;
+        ids = id_map->id_map;
+        data.assign(flat->get_xb(), flat->get_xb() + index_->ntotal * dim_);
+      }
+    }
+
+    if (!ids.empty()) {
+      auto sample = Sample(data, ids.size());
+      ivf->train(sample.size() / dim_, sample.data());
+      ivf->add_with_ids((faiss::idx_t)ids.size(), data.data(), ids.data());
+      return true;
+    }
+
+    // 重新训练：按步长从各倒排链采样训练，再逐条倒排链拷出全部向量；
+    // 单条链在一次共享锁内拷完，链内因删除发生的移动不会导致遗漏
+    size_t step = 1;
+    {
+      std::shared_lock lock(mutex_);
+      size_t max_train_size = std::max<size_t>(opts_.max_train_size, 1);
+      step = std::max<size_t>(1, (index_->ntotal + max_train_size - 1) / max_train_size);
+    }
+    std::vector<float> sample;
+    if (!ForEachList(epoch, [&](size_t list_no, size_t offset, faiss::idx_t /*id*/) {
+          if (offset % step == 0) {
+            sample.resize(sample.size() + dim_);
+            ivf_->reconstruct_from_offset(list_no, offset, sample.data() + sample.size() - dim_);
+          }
+        })) {
+      return false;
+    }
+    ivf->train(sample.size() / dim_, sample.data());
+    sample = std::vector<float>();
+
+    return ForEachList(
+        epoch,
+        [&](size_t list_no, size_t offset, faiss::idx_t id) {
+          ids.push_back(id);
+          data.resize(data.size() + dim_);
+          ivf_->reconstruct_from_offset(list_no, offset, data.data() + data.size() - dim_);
+        },
+        [&] {
+          ivf->add_with_ids((faiss::idx_t)ids.size(), data.data(), ids.data());
+          ids.clear();
+          data.clear();
+        });
+  }
+
+  // 逐链拷贝期间被修改的 id 可能从已拷贝的链移到未拷贝的链而被拷贝两次，哈希 direct map 只记录最后一份，
+  // 按 id 删除会漏掉其余副本。此时新索引尚未换入，不持锁扫描全部倒排链删除这些 id，由重放写回最终状态；
+  // 拷贝完成后才出现的操作不会造成重复，由 `Train` 在换入前逐个处理
+  void PurgeTouched(faiss::IndexIVF* ivf) {
+    std::vector<faiss::idx_t> labels;
+    {
+      std::shared_lock lock(mutex_);
+      labels.reserve(pending_ops_.size());
+      for (const auto& op : pending_ops_) {
+        labels.push_back(op.label);
+      }
+    }
+    if (labels.empty()) {
+      return;
+    }
+    ivf->set_direct_map_type(faiss::DirectMap::NoMap);
+    faiss::IDSelectorBatch selector(labels.size(), labels.data());
+    ivf->remove_ids(selector);
+    ivf->set_direct_map_type(faiss::DirectMap::Hashtable);
+  }
+
+  // 每条倒排链在一次共享锁内遍历，`on_list_done` 在释放锁后调用
+  template <typename F, typename G = void (*)()>
+  bool ForEachList(uint64_t epoch, F&& on_entry, G&& on_list_done = [] {}) {
+    for (size_t list_no = 0;; ++list_no) {
+      {
+        std::shared_lock lock(mutex_);
+        if (stopped_ || epoch_ != epoch || !ivf_) {
+          return false;
+        }
+        if (list_no >= ivf_->nlist) {
+          return true;
+        }
+        size_t list_size = ivf_->invlists->list_size(list_no);
+        faiss::InvertedLists::ScopedIds list_ids(ivf_->invlists, list_no);
+        for (size_t offset = 0; offset < list_size; ++offset) {
+          on_entry(list_no, offset, list_ids[offset]);
+        }
+      }
+      on_list_done();
+    }
+  }
+
+  // 训练样本不超过 `max_train_size`，等间隔抽取
+  std::vector<float> Sample(const std::vector<float>& data, size_t n) const {
+    size_t num_samples = std::min(n, std::max<size_t>(opts_.max_train_size, 1));
+    if (num_samples == n) {
+      return data;
+    }
+    std::vector<float> sample(num_samples * dim_);
+    for (size_t i = 0; i < num_samples; ++i) {
+      size_t src = i * n / num_samples;
+      std::copy(data.begin() + src * dim_, data.begin() + (src + 1) * dim_, sample.begin() + i * dim_);
+    }
+    return sample;
+  }
 };
 
 /************************************************************************/
@@ -111,50 +985,174 @@ class FaissIndex : public Index {
 /************************************************************************/
 class HNSWLibIndex : public Index {
  private:
+  // 删除只打墓碑（`markDelete`），新 label 优先复用墓碑槽位；墓碑比例超过阈值时在后台重建图。
+  // 重建期间的写操作记录在 `pending_ops_` 中，换入新图前按顺序重放。
+  // FP16/SQ8 存储时图中保存编码后的向量，查询以同样方式编码后直接在编码上计算距离。
   int dim_{0};
+  MetricType metric_{MetricType::L2};
+  HNSWOptions opts_;
+  // 每个向量在图中占用的字节数
+  size_t data_size_{0};
+  // 搜索共享，插入/删除独占
+  mutable std::shared_mutex mutex_;
   std::unique_ptr<hnswlib::SpaceInterface<float>> space_;
   std::unique_ptr<hnswlib::HierarchicalNSW<float>> index_;
+  // 批量插入与多查询搜索时使用，第一次需要并行时才创建
+  std::once_flag pool_once_;
+  std::unique_ptr<ThreadPool> pool_;
+
+  // 以下成员由 `mutex_` 保护
+  bool compacting_{false};
+  std::vector<PendingIndexOp> pending_ops_;
+  // `Load` 后递增，重建中途发现变化则放弃
+  uint64_t epoch_{0};
+  std::atomic<bool> stopped_{false};
+  std::thread compact_thread_;
 
  public:
-  HNSWLibIndex(int dim, int num_data, MetricType metric, int M, int ef_construction) {
+  HNSWLibIndex(int dim, MetricType metric, const HNSWOptions& opts) {
     dim_ = dim;
-    if (metric == MetricType::L2) {
+    metric_ = metric;
+    opts_ = opts;
+    opts_.growth_factor = std::max(opts.growth_factor, 1.1);
+    if (opts.storage != StorageType::FP32) {
+      space_ = NewQuantizedSpace(opts.storage, metric, dim);
+    } else if (metric == MetricType::L2) {
       space_ = std::make_unique<hnswlib::L2Space>(dim);
+    } else if (metric == MetricType::IP || metric == MetricType::COSINE) {
+      space_ = std::make_unique<hnswlib::InnerProductSpace>(dim);
     } else {
       throw std::runtime_error("Invalid metric type.");
     }
-    index_ = std::make_unique<hnswlib::HierarchicalNSW<float>>(space_.get(), num_data, M, ef_construction);
+    data_size_ = space_->get_data_size();
+    index_ = NewGraph(opts_.num_data);
+  }
+
+  ~HNSWLibIndex() override {
+    stopped_ = true;
+    if (compact_thread_.joinable()) {
+      compact_thread_.join();
+    }
   }
-  ~HNSWLibIndex() override = default;
 
  public:
-  void Insert(const InsertOptions& opts) override { index_->addPoint(opts.data, opts.label); }
+  void Insert(const InsertOptions& opts) override {
+    std::vector<float> buffer;
+    std::vector<char> codes;
+    const float* data = Normalize(metric_, opts.data, dim_, 1, &buffer);
+    const void* code = Encode(data, 1, &codes);
+    std::unique_lock lock(mutex_);
+    Reserve(index_.get(), 1);
+    AddPoint(index_.get(), code, opts.label);
+    if (compacting_) {
+      pending_ops_.push_back({false, opts.label, std::vector<float>(data, data + dim_)});
+    }
+    MaybeCompact();
+  }
 
-  SearchResult Search(const SearchOptions& opts) override {
-    index_->setEf(opts.ef_search);
+  // 持有独占锁排除搜索，`addPoint` 自身对不同 label 的并发插入是安全的
+  void InsertBatch(const InsertBatchOptions& batch_opts) override {
+    std::vector<float> buffer;
+    InsertBatchOptions opts = batch_opts;
+    std::vector<char> buffer_codes;
+    opts.data = Normalize(metric_, batch_opts.data, dim_, batch_opts.n, &buffer);
+    auto* codes = (const char*)Encode(opts.data, opts.n, &buffer_codes);
+    std::unique_lock lock(mutex_);
+    Reserve(index_.get(), opts.n);
+    if (compacting_) {
+      for (size_t i = 0; i < opts.n; ++i) {
+        pending_ops_.push_back(
+            {false, opts.labels[i], std::vector<float>(opts.data + i * dim_, opts.data + (i + 1) * dim_)});
+      }
+    }
 
-    HNSWRoaringBitmapIDFilter selector(opts.bitmap);
-    auto result = index_->searchKnn(opts.query, opts.k, opts.bitmap ? &selector : nullptr);
+    size_t num_tasks = std::min<size_t>(std::thread::hardware_concurrency(), opts.n / MIN_PARALLEL_INSERT_SIZE);
+    if (num_tasks <= 1) {
+      for (size_t i = 0; i < opts.n; ++i) {
+        AddPoint(index_.get(), codes + i * data_size_, opts.labels[i]);
+      }
+      MaybeCompact();
+      return;
+    }
 
-    std::vector<int64_t> indices;
-    std::vector<float> distances;
-    while (!result.empty()) {
-      auto item = result.top();
-      indices.push_back(item.second);
-      distances.push_back(item.first);
-      result.pop();
+    std::vector<std::future<void>> futures;
+    futures.reserve(num_tasks);
+    for (size_t t = 0; t < num_tasks; ++t) {
+      futures.push_back(GetPool()->Submit([this, &opts, codes, t, num_tasks] {
+        for (size_t i = t; i < opts.n; i += num_tasks) {
+          AddPoint(index_.get(), codes + i * data_size_, opts.labels[i]);
+        }
+      }));
+    }
+    // 先等所有任务结束再抛出异常，任务引用了 `opts`
+    for (auto& future : futures) {
+      future.wait();
     }
+    for (auto& future : futures) {
+      future.get();
+    }
+    MaybeCompact();
+  }
 
-    return {indices, distances};
+  // 多个查询分发到线程池并行执行，`searchKnn` 本身支持并发调用
+  SearchResult Search(const SearchOptions& search_opts) override {
+    size_t num_queries = search_opts.size / dim_;
+    std::vector<float> buffer;
+    SearchOptions opts = search_opts;
+    std::vector<char> buffer_codes;
+    opts.query = Normalize(metric_, search_opts.query, dim_, num_queries, &buffer);
+    auto* queries = (const char*)Encode(opts.query, num_queries, &buffer_codes);
+    std::shared_lock lock(mutex_);
+    SearchResult result;
+    result.indices.assign(num_queries * opts.k, -1);
+    result.distances.assign(num_queries * opts.k, std::numeric_limits<float>::max());
+    std::vector<hnswlib::tableint> filtered;
+    const std::vector<hnswlib::tableint>* candidates = nullptr;
+    if (opts.bitmap && opts.filter_plan == FilterPlan::PRE_FILTER) {
+      CollectFiltered(opts.bitmap, &filtered);
+      candidates = &filtered;
+    }
+
+    if (num_queries <= 1) {
+      for (size_t q = 0; q < num_queries; ++q) {
+        SearchOne(opts, queries + q * data_size_, q, candidates, &result);
+      }
+      return result;
+    }
+
+    size_t num_tasks = std::min<size_t>(std::thread::hardware_concurrency(), num_queries);
+    std::vector<std::future<void>> futures;
+    futures.reserve(num_tasks);
+    for (size_t t = 0; t < num_tasks; ++t) {
+      futures.push_back(GetPool()->Submit([this, &opts, &result, queries, candidates, t, num_tasks, num_queries] {
+        for (size_t q = t; q < num_queries; q += num_tasks) {
+          SearchOne(opts, queries + q * data_size_, q, candidates, &result);
+        }
+      }));
+    }
+    for (auto& future : futures) {
+      future.wait();
+    }
+    for (auto& future : futures) {
+      future.get();
+    }
+    return result;
   }
 
-  void Remove(const std::vector<int64_t>& /*ids*/) override {
-    // Todo(cong): 示例代码没实现？
-    return;
+  void Remove(const std::vector<int64_t>& ids) override {
+    std::unique_lock lock(mutex_);
+    for (auto id : ids) {
+      MarkDelete(index_.get(), id);
+      if (compacting_) {
+        pending_ops_.push_back({true, id, {}});
+      }
+    }
+    MaybeCompact();
   }
 
-  bool Save(const std::string& path) override {
-    index_->saveIndex(path);
+  bool Serialize(const std::string& name, IndexFiles* files) override {
+    std::shared_lock lock(mutex_);
+    files->emplace_back(name, WriteGraph(*index_));
     return true;
   }
 
@@ -162,11 +1160,312 @@ class HNSWLibIndex : public Index {
     std::ifstream file(path);
     if (file.good()) {
       file.close();
+      std::unique_lock lock(mutex_);
       index_->loadIndex(path, space_.get());
+      ++epoch_;
+      // 文件中的向量长度由存储精度决定，与当前配置不一致时无法使用
+      if (index_->label_offset_ - index_->offsetData_ != data_size_) {
+        LOG(WARNING) << "Failed to load HNSW index with different storage type, path=" << path << ".";
+        index_ = NewGraph(opts_.num_data);
+        return false;
+      }
       return true;
     }
     return true;
   }
+
+  size_t Size() const override {
+    std::shared_lock lock(mutex_);
+    return index_->getCurrentElementCount() - index_->getDeletedCount();
+  }
+
+  float Distance(const float* x, const float* y) const override {
+    return ExactDistance(metric_, x, y, dim_, IsSimilarity());
+  }
+
+  bool IsSimilarity() const override { return false; }
+
+ private:
+  std::unique_ptr<hnswlib::HierarchicalNSW<float>> NewGraph(size_t capacity) {
+    return std::make_unique<hnswlib::HierarchicalNSW<float>>(space_.get(), std::max<size_t>(capacity, 1), opts_.M,
+                                                             opts_.ef_construction, 100, true);
+  }
+
+  // 需持有锁。与 `saveIndex` 写出的格式相同（由 `loadIndex` 读取），但写入内存，避免持锁期间做磁盘 IO
+  static std::string WriteGraph(const hnswlib::HierarchicalNSW<float>& graph) {
+    size_t count = graph.cur_element_count;
+    std::string data;
+    data.reserve(count * (graph.size_data_per_element_ + sizeof(unsigned int)) + 128);
+    auto write = [&data](const auto& pod) { data.append((const char*)&pod, sizeof(pod)); };
+    write(graph.offsetLevel0_);
+    write(graph.max_elements_);
+    write(count);
+    write(graph.size_data_per_element_);
+    write(graph.label_offset_);
+    write(graph.offsetData_);
+    write(graph.maxlevel_);
+    write(graph.enterpoint_node_);
+    write(graph.maxM_);
+    write(graph.maxM0_);
+    write(graph.M_);
+    write(graph.mult_);
+    write(graph.ef_construction_);
+    data.append(graph.data_level0_memory_, count * graph.size_data_per_element_);
+    for (size_t i = 0; i < count; ++i) {
+      unsigned int size = graph.element_levels_[i] > 0 ? graph.size_links_per_element_ * graph.element_levels_[i] : 0;
+      write(size);
+      if (size > 0) {
+        data.append(graph.linkLists_[i], size);
+      }
+    }
+    return data;
+  }
+
+  // 需持有独占锁。墓碑槽位可被复用，只有超出部分需要新槽位；更新已有 label 时可能提前扩容
+  void Reserve(hnswlib::HierarchicalNSW<float>* graph, size_t n) {
+    size_t capacity = graph->getMaxElements();
+    size_t required = graph->getCurrentElementCount() + n;
+    size_t vacant = graph->getDeletedCount();
+    required = required > vacant ? required - vacant : 0;
+    if (required <= capacity) {
+      return;
+    }
+    size_t new_capacity = std::max(required, (size_t)(capacity * opts_.growth_factor));
+    LOG(INFO) << "Resizing HNSW index, capacity=" << capacity << ",new_capacity=" << new_capacity << ".";
+    graph->resizeIndex(new_capacity);
+  }
+
+  // 已存在的 label 原地更新（带墓碑的先取消删除），新 label 优先复用墓碑槽位。
+  // 不能让同一 label 占用两个槽位，否则复用旧槽位时会误删 `label_lookup_` 中的新映射。
+  static void AddPoint(hnswlib::HierarchicalNSW<float>* graph, const void* data, int64_t label) {
+    auto l = (hnswlib::labeltype)label;
+    bool exists = false;
+    bool deleted = false;
+    {
+      std::lock_guard lock(graph->label_lookup_lock);
+      auto it = graph->label_lookup_.find(l);
+      if (it != graph->label_lookup_.end()) {
+        exists = true;
+        deleted = graph->isMarkedDeleted(it->second);
+      }
+    }
+    if (deleted) {
+      graph->unmarkDelete(l);
+    }
+    graph->addPoint(data, l, !exists);
+  }
+
+  static void MarkDelete(hnswlib::HierarchicalNSW<float>* graph, int64_t label) {
+    auto l = (hnswlib::labeltype)label;
+    {
+      std::lock_guard lock(graph->label_lookup_lock);
+      auto it = graph->label_lookup_.find(l);
+      if (it == graph->label_lookup_.end() || graph->isMarkedDeleted(it->second)) {
+        return;
+      }
+    }
+    graph->markDelete(l);
+  }
+
+  // 需持有独占锁
+  void MaybeCompact() {
+    if (compacting_ || opts_.compact_ratio <= 0) {
+      return;
+    }
+    size_t deleted = index_->getDeletedCount();
+    if (deleted < opts_.compact_min_deleted || deleted < opts_.compact_ratio * index_->getCurrentElementCount()) {
+      return;
+    }
+    if (compact_thread_.joinable()) {
+      compact_thread_.join();
+    }
+    LOG(INFO) << "Start to compacting HNSW index, deleted=" << deleted
+              << ",elements=" << index_->getCurrentElementCount() << ".";
+    compacting_ = true;
+    compact_thread_ = std::thread([this] { Compact(); });
+  }
+
+  // 分块在共享锁下拷出存活向量并插入新图，块之间写请求可继续执行；最后在独占锁下重放期间的写操作并换入新图
+  void Compact() {
+    uint64_t epoch = 0;
+    size_t num_elements = 0;
+    size_t num_live = 0;
+    {
+      std::shared_lock lock(mutex_);
+      epoch = epoch_;
+      num_elements = index_->getCurrentElementCount();
+      num_live = num_elements - index_->getDeletedCount();
+    }
+
+    auto graph = NewGraph(std::max(num_live, opts_.num_data));
+    std::vector<int64_t> labels;
+    std::vector<char> data;
+    bool aborted = false;
+    for (size_t begin = 0; begin < num_elements && !aborted; begin += COMPACT_CHUNK_SIZE) {
+      labels.clear();
+      data.clear();
+      {
+        std::shared_lock lock(mutex_);
+        if (stopped_ || epoch_ != epoch) {
+          aborted = true;
+          break;
+        }
+        size_t end = std::min(begin + COMPACT_CHUNK_SIZE, num_elements);
+        for (size_t id = begin; id < end; ++id) {
+          auto internal_id = (hnswlib::tableint)id;
+          if (index_->isMarkedDeleted(internal_id)) {
+            continue;
+          }
+          labels.push_back((int64_t)index_->getExternalLabel(internal_id));
+          const char* vec = index_->getDataByInternalId(internal_id);
+          data.insert(data.end(), vec, vec + data_size_);
+        }
+      }
+      Reserve(graph.get(), labels.size());
+      for (size_t i = 0; i < labels.size(); ++i) {
+        graph->addPoint(data.data() + i * data_size_, (hnswlib::labeltype)labels[i]);
+      }
+    }
+
+    std::unique_lock lock(mutex_);
+    compacting_ = false;
+    if (aborted || stopped_ || epoch_ != epoch) {
+      pending_ops_.clear();
+      LOG(INFO) << "Abort compacting HNSW index.";
+      return;
+    }
+    std::vector<char> codes;
+    for (const auto& op : pending_ops_) {
+      if (op.remove) {
+        MarkDelete(graph.get(), op.label);
+      } else {
+        Reserve(graph.get(), 1);
+        AddPoint(graph.get(), Encode(op.data.data(), 1, &codes), op.label);
+      }
+    }
+    LOG(INFO) << "Finish to compacting HNSW index, elements=" << index_->getCurrentElementCount()
+              << ",new_elements=" << graph->getCurrentElementCount() << ",replayed_ops=" << pending_ops_.size() << ".";
+    pending_ops_.clear();
+    index_ = std::move(graph);
+  }
+
+  // 同 `searchKnn`，但 ef 由调用方传入而不读写图中共享的 `ef_`，可并发调用
+  std::priority_queue<std::pair<float, hnswlib::labeltype>> SearchKnn(const void* query, size_t k, size_t ef,
+                                                                      hnswlib::BaseFilterFunctor* filter) const {
+    std::priority_queue<std::pair<float, hnswlib::labeltype>> result;
+    auto* graph = index_.get();
+    if (graph->getCurrentElementCount() == 0) {
+      return result;
+    }
+
+    // 上层贪心下降到第 0 层的入口
+    hnswlib::tableint cur = graph->enterpoint_node_;
+    float cur_dist = graph->fstdistfunc_(query, graph->getDataByInternalId(cur), graph->dist_func_param_);
+    for (int level = graph->maxlevel_; level > 0; --level) {
+      bool changed = true;
+      while (changed) {
+        changed = false;
+        hnswlib::linklistsizeint* links = graph->get_linklist(cur, level);
+        int size = graph->getListCount(links);
+        auto* neighbors = (hnswlib::tableint*)(links + 1);
+        for (int i = 0; i < size; ++i) {
+          float dist = graph->fstdistfunc_(query, graph->getDataByInternalId(neighbors[i]), graph->dist_func_param_);
+          if (dist < cur_dist) {
+            cur_dist = dist;
+            cur = neighbors[i];
+            changed = true;
+          }
+        }
+      }
+    }
+
+    auto top = (graph->getDeletedCount() == 0 && !filter) ? graph->searchBaseLayerST<true>(cur, query, ef)
+                                                          : graph->searchBaseLayerST<false>(cur, query, ef, filter);
+    while (top.size() > k) {
+      top.pop();
+    }
+    while (!top.empty()) {
+      result.emplace(top.top().first, graph->getExternalLabel(top.top().second));
+      top.pop();
+    }
+    return result;
+  }
+
+  // FP32 存储时直接返回 `data`，否则编码到 `buffer` 中
+  const void* Encode(const float* data, size_t n, std::vector<char>* buffer) const {
+    if (opts_.storage == StorageType::FP32) {
+      return data;
+    }
+    buffer->resize(n * data_size_);
+    EncodeVectors(opts_.storage, data, dim_, n, buffer->data());
+    return buffer->data();
+  }
+
+  ThreadPool* GetPool() {
+    std::call_once(pool_once_, [this] { pool_ = std::make_unique<ThreadPool>(std::thread::hardware_concurrency()); });
+    return pool_.get();
+  }
+
+  // 需持有锁。查出过滤位图命中的存活槽位，升序排列便于顺序访存。
+  // 持有共享锁时没有写者，可以不加 `label_lookup_lock` 直接读
+  void CollectFiltered(const roaring_bitmap_t* bitmap, std::vector<hnswlib::tableint>* internal_ids) const {
+    std::vector<uint32_t> labels(roaring_bitmap_get_cardinality(bitmap));
+    roaring_bitmap_to_uint32_array(bitmap, labels.data());
+    internal_ids->reserve(labels.size());
+    for (auto label : labels) {
+      auto it = index_->label_lookup_.find(label);
+      if (it != index_->label_lookup_.end() && !index_->isMarkedDeleted(it->second)) {
+        internal_ids->push_back(it->second);
+      }
+    }
+    std::sort(internal_ids->begin(), internal_ids->end());
+  }
+
+  // 逐个计算候选的距离并维护大小为 `k` 的大顶堆，距离函数为 hnswlib 按 CPU 运行时选择的 SIMD 实现
+  std::priority_queue<std::pair<float, hnswlib::labeltype>> SearchFiltered(
+      const void* query, size_t k, const std::vector<hnswlib::tableint>& internal_ids) const {
+    std::priority_queue<std::pair<float, hnswlib::labeltype>> result;
+    auto* graph = index_.get();
+    for (auto internal_id : internal_ids) {
+      float dist = graph->fstdistfunc_(query, graph->getDataByInternalId(internal_id), graph->dist_func_param_);
+      if (result.size() < k) {
+        result.emplace(dist, graph->getExternalLabel(internal_id));
+      } else if (dist < result.top().first) {
+        result.pop();
+        result.emplace(dist, graph->getExternalLabel(internal_id));
+      }
+    }
+    return result;
+  }
+
+  // 结果写入第 `q` 行，`candidates` 非空时只在其中暴力搜索；堆为大顶堆，倒序填充得到升序
+  void SearchOne(const SearchOptions& opts, const void* query, size_t q,
+                 const std::vector<hnswlib::tableint>* candidates, SearchResult* result) {
+    auto k = (size_t)opts.k;
+    std::priority_queue<std::pair<float, hnswlib::labeltype>> knn;
+    if (candidates) {
+      knn = SearchFiltered(query, k, *candidates);
+    } else {
+      HNSWRoaringBitmapIDFilter selector(opts.bitmap);
+      hnswlib::BaseFilterFunctor* filter = opts.bitmap ? &selector : nullptr;
+      size_t ef = std::max<size_t>(opts.ef_search > 0 ? opts.ef_search : opts_.ef_search, k);
+      knn = SearchKnn(query, k, ef, filter);
+      if (opts.adaptive_ef) {
+        size_t num_live = index_->getCurrentElementCount() - index_->getDeletedCount();
+        size_t max_ef = std::min(MAX_ADAPTIVE_EF_SEARCH, num_live);
+        while (knn.size() < std::min(k, num_live) && ef < max_ef) {
+          ef = std::min(ef * 2, max_ef);
+          knn = SearchKnn(query, k, ef, filter);
+        }
+      }
+    }
+    size_t offset = q * opts.k;
+    for (size_t i = knn.size(); i > 0; --i) {
+      result->indices[offset + i - 1] = (int64_t)knn.top().second;
+      result->distances[offset + i - 1] = knn.top().first;
+      knn.pop();
+    }
+  }
 };
 
 }  // namespace
@@ -174,9 +1473,52 @@ class HNSWLibIndex : public Index {
 /************************************************************************/
 /* Index functions */
 /************************************************************************/
-std::unique_ptr<Index> NewFaissIndex(int dim, MetricType metric) { return std::make_unique<FaissIndex>(dim, metric); }
-std::unique_ptr<Index> NewHNSWLibIndex(int dim, int num_data, MetricType metric, int M, int ef_construction) {
-  return std::make_unique<HNSWLibIndex>(dim, num_data, metric, M, ef_construction);
+const char* FilterPlanToString(FilterPlan plan) {
+  switch (plan) {
+    case FilterPlan::PRE_FILTER:
+      return "pre_filter";
+    case FilterPlan::IN_FILTER:
+      return "in_filter";
+    case FilterPlan::POST_FILTER:
+      return "post_filter";
+  }
+  return "unknown";
+}
+
+bool StringToStorageType(const std::string& str, StorageType* storage) {
+  if (str == "fp32") {
+    *storage = StorageType::FP32;
+  } else if (str == "fp16") {
+    *storage = StorageType::FP16;
+  } else if (str == "sq8") {
+    *storage = StorageType::SQ8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool StringToMetricType(const std::string& str, MetricType* metric) {
+  if (str == "l2") {
+    *metric = MetricType::L2;
+  } else if (str == "ip") {
+    *metric = MetricType::IP;
+  } else if (str == "cosine") {
+    *metric = MetricType::COSINE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<Index> NewFaissIndex(int dim, MetricType metric, const FlatOptions& opts) {
+  return std::make_unique<FaissIndex>(dim, metric, opts);
+}
+std::unique_ptr<Index> NewHNSWLibIndex(int dim, MetricType metric, const HNSWOptions& opts) {
+  return std::make_unique<HNSWLibIndex>(dim, metric, opts);
+}
+std::unique_ptr<Index> NewFaissIVFIndex(int dim, MetricType metric, const IVFOptions& opts) {
+  return std::make_unique<FaissIVFIndex>(dim, metric, opts);
 }
 
 }  // namespace vdb
@@ -5,15 +5,31 @@
 #include <stdint.h>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace vdb {
 
-enum class MetricType { L2, IP };
+// COSINE 在插入与查询时先归一化，再按内积计算
+enum class MetricType { L2, IP, COSINE };
+
+// 向量在索引中的存储精度，FP16/SQ8 分别节省 2/4 倍内存，距离直接在编码上计算
+enum class StorageType { FP32, FP16, SQ8 };
+
+// 带过滤条件的搜索的执行方式，由调用方根据过滤位图的选择性决定
+enum class FilterPlan {
+  PRE_FILTER,   // 只对位图命中的 id 精确计算距离，不支持的索引按 IN_FILTER 执行
+  IN_FILTER,    // 在索引中边搜索边过滤
+  POST_FILTER,  // 不带过滤条件搜索，由调用方筛选结果
+};
+
+// 序列化到内存的索引文件：（文件名, 内容）
+using IndexFiles = std::vector<std::pair<std::string, std::string>>;
 
 /************************************************************************/
 /* Index */
 /************************************************************************/
+// 实现需自行保证线程安全：`Search`/`Serialize` 之间可并发，`Insert`/`Remove`/`Load` 独占。
 class Index {
  public:
   struct InsertOptions {
@@ -21,14 +37,30 @@ class Index {
     int64_t label{-1};
   };
 
+  // `data` 为 `n` 个连续存放的向量，`labels` 互不相同
+  struct InsertBatchOptions {
+    const float* data{nullptr};
+    const int64_t* labels{nullptr};
+    size_t n{0};
+  };
+
+  // `query` 为 `size / dim` 个连续存放的查询向量
   struct SearchOptions {
     const float* query{nullptr};
     size_t size{0};
     int k{0};
-    int ef_search{50};
+    // HNSW 搜索的候选集大小，0 表示使用索引的默认值；小于 `k` 时按 `k` 计
+    int ef_search{0};
+    // HNSW 因过滤或墓碑得到的结果不足 `k` 个时倍增 ef 重试
+    bool adaptive_ef{false};
+    // IVF 搜索的倒排链数，0 表示使用索引的默认值
+    int nprobe{0};
     const roaring_bitmap_t* bitmap{nullptr};
+    FilterPlan filter_plan{FilterPlan::IN_FILTER};
   };
 
+  // 按查询顺序排列，每个查询 `k` 个结果，由近到远，不足 `k` 个时以 -1 补齐。
+  // 距离沿用底层库的定义：Faiss 的 IP/COSINE 为内积（降序），HNSW 为 1 - 内积（升序）
   struct SearchResult {
     std::vector<int64_t> indices;
     std::vector<float> distances;
@@ -44,16 +76,69 @@ class Index {
 
  public:
   virtual void Insert(const InsertOptions& opts) = 0;
+  virtual void InsertBatch(const InsertBatchOptions& opts) = 0;
   [[nodiscard]] virtual SearchResult Search(const SearchOptions& opts) = 0;
   virtual void Remove(const std::vector<int64_t>& ids) = 0;
-  [[nodiscard]] virtual bool Save(const std::string& path) = 0;
+  // 只在共享锁下拷贝到内存，写文件由调用方在锁外完成；`name` 为主文件名，附加文件以其为前缀。
+  // `Load(dir/name)` 可读回写到 `dir` 下的这些文件
+  [[nodiscard]] virtual bool Serialize(const std::string& name, IndexFiles* files) = 0;
   [[nodiscard]] virtual bool Load(const std::string& path) = 0;
+  // 存活的向量数
+  [[nodiscard]] virtual size_t Size() const = 0;
+  // 以 fp32 精确计算距离，口径与 `Search` 返回的距离一致，用于压缩存储时的精排
+  [[nodiscard]] virtual float Distance(const float* x, const float* y) const = 0;
+  // `Search` 返回的距离越大越相似时为 true
+  [[nodiscard]] virtual bool IsSimilarity() const = 0;
 };
 
 /************************************************************************/
 /* Index functions */
 /************************************************************************/
-std::unique_ptr<Index> NewFaissIndex(int dim, MetricType metric);
-std::unique_ptr<Index> NewHNSWLibIndex(int dim, int num_data, MetricType metric, int M = 16, int ef_construction = 200);
+struct HNSWOptions {
+  // 初始容量，写满后按 `growth_factor` 扩容
+  size_t num_data{1000};
+  double growth_factor{2.0};
+  int M{16};
+  int ef_construction{200};
+  // 默认的搜索候选集大小
+  int ef_search{50};
+  // 墓碑数不少于 `compact_min_deleted` 且占比超过 `compact_ratio` 时后台重建图，`compact_ratio` 为 0 表示不重建
+  double compact_ratio{0.3};
+  size_t compact_min_deleted{1024};
+  // SQ8 为逐向量量化（每个向量各自的最小值与步长），无需训练
+  StorageType storage{StorageType::FP32};
+};
+
+struct FlatOptions {
+  // SQ8 攒够一定数量的向量后才训练并转存，之前以 fp32 存储
+  StorageType storage{StorageType::FP32};
+  // SQ8 存活向量数增长到上次训练时的该倍数且写入过超出训练范围的向量时后台重新训练，不大于 1 表示不重新训练
+  double retrain_growth{4.0};
+  // 墓碑数不少于 `compact_min_deleted` 且占比超过 `compact_ratio` 时后台重建，`compact_ratio` 为 0 表示不重建
+  double compact_ratio{0.3};
+  size_t compact_min_deleted{1024};
+};
+
+[[nodiscard]] bool StringToMetricType(const std::string& str, MetricType* metric);
+[[nodiscard]] bool StringToStorageType(const std::string& str, StorageType* storage);
+const char* FilterPlanToString(FilterPlan plan);
+
+struct IVFOptions {
+  size_t nlist{1024};
+  // 默认搜索的倒排链数
+  size_t nprobe{16};
+  // 大于 0 时使用 IVF-PQ，`dim` 需能被 `pq_m` 整除
+  size_t pq_m{0};
+  size_t pq_nbits{8};
+  // 缓冲多少个向量后开始训练，0 表示 `39 * nlist`
+  size_t train_size{0};
+  size_t max_train_size{256 * 1024};
+  // 向量数增长到上次训练时的多少倍后重新训练，不大于 1 表示不重新训练
+  double retrain_growth{4.0};
+};
+
+std::unique_ptr<Index> NewFaissIndex(int dim, MetricType metric, const FlatOptions& opts);
+std::unique_ptr<Index> NewHNSWLibIndex(int dim, MetricType metric, const HNSWOptions& opts);
+std::unique_ptr<Index> NewFaissIVFIndex(int dim, MetricType metric, const IVFOptions& opts);
 
 }  // namespace vdb
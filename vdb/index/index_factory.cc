@@ -6,8 +6,10 @@ namespace vdb {
 
 namespace {
 
+std::string BuildSaveName(service::IndexType type) { return std::to_string(type) + ".index"; }
+
 std::string BuildSavePath(const std::string& path, service::IndexType type) {
-  return path + "/" + std::to_string(type) + ".index";
+  return path + "/" + BuildSaveName(type);
 }
 
 }  // namespace
@@ -27,11 +29,23 @@ Index* IndexFactory::GetIndex(service::IndexType type) const {
   return it->second.get();
 }
 
-bool IndexFactory::SaveIndex(const std::string& path) {
+std::vector<Index*> IndexFactory::GetIndexes() const {
+  std::vector<Index*> indexes;
+  indexes.reserve(type_2_index_.size());
   for (const auto& [type, index] : type_2_index_) {
-    std::string file_path = BuildSavePath(path, type);
-    if (!index->Save(file_path)) {
-      LOG(WARNING) << "Failed to save index, type=" << type << ",path=" << file_path << ".";
+    indexes.push_back(index.get());
+  }
+  return indexes;
+}
+
+bool IndexFactory::SerializeIndex(const std::function<bool(const IndexFiles& files)>& on_index) const {
+  for (const auto& [type, index] : type_2_index_) {
+    IndexFiles files;
+    if (!index->Serialize(BuildSaveName(type), &files)) {
+      LOG(WARNING) << "Failed to serialize index, type=" << type << ".";
+      return false;
+    }
+    if (!on_index(files)) {
       return false;
     }
   }
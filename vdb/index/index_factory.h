@@ -1,9 +1,11 @@
 #pragma once
 
 #include <gen_cpp/vdb.pb.h>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "index/index.h"
 
 namespace vdb {
@@ -18,7 +20,10 @@ class IndexFactory {
  public:
   void Add(service::IndexType type, std::unique_ptr<Index>&& index);
   Index* GetIndex(service::IndexType type) const;
-  [[nodiscard]] bool SaveIndex(const std::string& path);
+  std::vector<Index*> GetIndexes() const;
+  // 逐个索引在它自己的共享锁下序列化到内存并交给 `on_index`，文件名相对 snapshot 目录；
+  // 同一时刻只保留一个索引的拷贝
+  [[nodiscard]] bool SerializeIndex(const std::function<bool(const IndexFiles& files)>& on_index) const;
   [[nodiscard]] bool LoadIndex(const std::string& path);
 };
 
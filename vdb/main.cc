@@ -13,7 +13,38 @@ DEFINE_int32(idle_timeout_s, -1,
              "Connection will be closed if there is no "
              "read/write operations during the last `idle_timeout_s'");
 DEFINE_int32(vec_dim, 1, "Dimension of each vector");
+DEFINE_string(metric, "l2", "Distance metric of all indexes: l2, ip, cosine");
+DEFINE_string(storage, "fp32", "Precision of vectors stored in the FLAT and HNSW indexes: fp32, fp16, sq8");
+DEFINE_int32(rerank_factor, 0,
+             "Re-rank k * rerank_factor candidates of compressed indexes with the exact fp32 vectors, 0 to disable");
+DEFINE_double(flat_compact_ratio, 0.3,
+              "Rebuild the FLAT index in the background once this fraction of its vectors are deleted, 0 to disable");
+DEFINE_double(flat_retrain_growth, 4.0,
+              "Retrain the SQ8 quantizer of the FLAT index once it grows by this factor and vectors fall outside "
+              "the trained range, 1 to disable");
+DEFINE_int32(hnsw_initial_capacity, 1000, "Initial number of vectors the HNSW index can hold before growing");
+DEFINE_double(hnsw_growth_factor, 2.0, "HNSW index capacity is multiplied by this factor whenever it is full");
+DEFINE_int32(hnsw_ef_search, 50, "Default ef of HNSW searches that do not specify ef_search");
+DEFINE_double(hnsw_compact_ratio, 0.3,
+              "Rebuild the HNSW graph in the background once this fraction of its slots are tombstones, 0 to disable");
+DEFINE_int32(ivf_nlist, 1024, "Number of inverted lists of IVF indexes");
+DEFINE_int32(ivf_nprobe, 16, "Default number of inverted lists probed by an IVF search");
+DEFINE_int32(ivf_train_size, 0, "Vectors buffered before an IVF index is trained, 0 means 39 * ivf_nlist");
+DEFINE_double(ivf_retrain_growth, 4.0, "Retrain an IVF index once it grows by this factor since the last training");
+DEFINE_int32(ivfpq_m, 8, "Number of PQ sub-quantizers of the IVFPQ index, must divide vec_dim");
 DEFINE_string(persistence_path, "./storage/", "Path to store persistent data");
+DEFINE_string(wal_sync_policy, "per-request",
+              "Durability of WAL writes: none, batch (fsync every `wal_sync_interval_ms'), per-request");
+DEFINE_int32(wal_sync_interval_ms, 10, "Group commit interval of WAL when `wal_sync_policy' is batch");
+DEFINE_int32(wal_segment_size_mb, 64, "WAL rolls over to a new segment file once the current one exceeds this size");
+DEFINE_int32(replay_threads, 0, "Number of threads decoding WAL records on startup, 0 means the number of cores");
+DEFINE_int32(filter_cache_mb, 64, "Memory budget of the cache of evaluated filter bitmaps, 0 disables the cache");
+DEFINE_int32(auto_snapshot_wal_mb, 0, "Take a snapshot once the WAL since the last one exceeds this size in MB");
+DEFINE_int64(auto_snapshot_wal_records, 0, "Take a snapshot once the WAL since the last one exceeds this many records");
+DEFINE_int64(auto_snapshot_interval_s, 0, "Take a snapshot once this many seconds have passed since the last one");
+DEFINE_int64(auto_snapshot_min_interval_s, 60, "Minimum seconds between two automatic snapshots");
+DEFINE_double(auto_snapshot_max_load, 0,
+              "Defer automatic snapshots while the 1-minute load average per core exceeds this, 0 to disable");
 DEFINE_bool(show_info, false, "show version");
 
 int main(int argc, char* argv[]) {
@@ -38,6 +69,40 @@ int main(int argc, char* argv[]) {
   auto db_opts = &opts.db_opts;
   db_opts->persistence_path = FLAGS_persistence_path;
   db_opts->dim = FLAGS_vec_dim;
+  if (!vdb::StringToMetricType(FLAGS_metric, &db_opts->metric)) {
+    LOG(ERROR) << "Invalid metric:" << FLAGS_metric << ".";
+    return -1;
+  }
+  if (!vdb::StringToStorageType(FLAGS_storage, &db_opts->storage)) {
+    LOG(ERROR) << "Invalid storage:" << FLAGS_storage << ".";
+    return -1;
+  }
+  db_opts->rerank_factor = FLAGS_rerank_factor;
+  db_opts->flat_compact_ratio = FLAGS_flat_compact_ratio;
+  db_opts->flat_retrain_growth = FLAGS_flat_retrain_growth;
+  db_opts->num_data = FLAGS_hnsw_initial_capacity;
+  db_opts->hnsw_growth_factor = FLAGS_hnsw_growth_factor;
+  db_opts->hnsw_compact_ratio = FLAGS_hnsw_compact_ratio;
+  db_opts->hnsw_ef_search = FLAGS_hnsw_ef_search;
+  db_opts->ivf_opts.nlist = FLAGS_ivf_nlist;
+  db_opts->ivf_opts.nprobe = FLAGS_ivf_nprobe;
+  db_opts->ivf_opts.train_size = FLAGS_ivf_train_size;
+  db_opts->ivf_opts.retrain_growth = FLAGS_ivf_retrain_growth;
+  db_opts->ivfpq_m = FLAGS_ivfpq_m;
+  if (!vdb::StringToSyncPolicy(FLAGS_wal_sync_policy, &db_opts->wal_sync_policy)) {
+    LOG(ERROR) << "Invalid wal_sync_policy:" << FLAGS_wal_sync_policy << ".";
+    return -1;
+  }
+  db_opts->wal_sync_interval_ms = FLAGS_wal_sync_interval_ms;
+  db_opts->wal_segment_size = (size_t)FLAGS_wal_segment_size_mb << 20;
+  db_opts->replay_threads = FLAGS_replay_threads;
+  db_opts->filter_cache_bytes = (size_t)FLAGS_filter_cache_mb << 20;
+  auto snapshot_opts = &opts.snapshot_opts;
+  snapshot_opts->wal_bytes = (uint64_t)FLAGS_auto_snapshot_wal_mb << 20;
+  snapshot_opts->wal_records = FLAGS_auto_snapshot_wal_records;
+  snapshot_opts->interval_s = FLAGS_auto_snapshot_interval_s;
+  snapshot_opts->min_interval_s = FLAGS_auto_snapshot_min_interval_s;
+  snapshot_opts->max_load = FLAGS_auto_snapshot_max_load;
   if (!server.Init(opts)) {
     LOG(ERROR) << "Fail to init VdbServer.";
     return -1;
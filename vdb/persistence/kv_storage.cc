@@ -2,6 +2,8 @@
 #include <glog/logging.h>
 #include <rocksdb/db.h>
 #include <rocksdb/options.h>
+#include <rocksdb/write_batch.h>
+#include <memory>
 
 namespace vdb {
 
@@ -31,9 +33,11 @@ class KVStorage::Impl {
     return true;
   }
 
-  bool Put(std::string_view key, std::string_view value) {
+  bool Put(std::string_view key, std::string_view value, bool sync) {
     // TODO(cong): WriteOptions 可设置？
-    auto st = db_->Put(rocksdb::WriteOptions(), key, value);
+    rocksdb::WriteOptions write_options;
+    write_options.sync = sync;
+    auto st = db_->Put(write_options, key, value);
     if (!st.ok()) {
       LOG(WARNING) << "Failed to insert to RocksDB, key=" << key << ",status=" << st.ToString() << ".";
       return false;
@@ -53,6 +57,61 @@ class KVStorage::Impl {
     }
     return EC_OK;
   }
+
+  bool PutBatch(const std::vector<std::pair<std::string, std::string_view>>& kvs, bool sync) {
+    rocksdb::WriteBatch batch;
+    for (const auto& [key, value] : kvs) {
+      auto st = batch.Put(key, value);
+      if (!st.ok()) {
+        LOG(WARNING) << "Failed to add to RocksDB write batch, key=" << key << ",status=" << st.ToString() << ".";
+        return false;
+      }
+    }
+    rocksdb::WriteOptions write_options;
+    write_options.sync = sync;
+    auto st = db_->Write(write_options, &batch);
+    if (!st.ok()) {
+      LOG(WARNING) << "Failed to write batch to RocksDB, count=" << kvs.size() << ",status=" << st.ToString() << ".";
+      return false;
+    }
+    return true;
+  }
+
+  void MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                std::vector<ErrorCode>* ecs) const {
+    std::vector<rocksdb::Slice> slices(keys.begin(), keys.end());
+    auto statuses = db_->MultiGet(rocksdb::ReadOptions(), slices, values);
+    ecs->resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (statuses[i].ok()) {
+        (*ecs)[i] = EC_OK;
+      } else if (statuses[i].IsNotFound()) {
+        (*ecs)[i] = EC_NotFound;
+      } else {
+        LOG(WARNING) << "Failed to get from RocksDB, key=" << keys[i] << ",status=" << statuses[i].ToString() << ".";
+        (*ecs)[i] = EC_Undefined;
+      }
+    }
+  }
+
+  bool Scan(std::string_view prefix, const std::function<bool(std::string_view, std::string_view)>& fn) const {
+    std::unique_ptr<rocksdb::Iterator> it(db_->NewIterator(rocksdb::ReadOptions()));
+    for (it->Seek(prefix); it->Valid(); it->Next()) {
+      std::string_view key(it->key().data(), it->key().size());
+      if (key.substr(0, prefix.size()) != prefix) {
+        break;
+      }
+      if (!fn(key, std::string_view(it->value().data(), it->value().size()))) {
+        return false;
+      }
+    }
+    auto st = it->status();
+    if (!st.ok()) {
+      LOG(WARNING) << "Failed to scan RocksDB, prefix=" << prefix << ",status=" << st.ToString() << ".";
+      return false;
+    }
+    return true;
+  }
 };
 
 /************************************************************************/
@@ -64,8 +123,22 @@ KVStorage::~KVStorage() = default;
 
 bool KVStorage::Init(const std::string& path) { return impl_->Init(path); }
 
-bool KVStorage::Put(std::string_view key, std::string_view value) { return impl_->Put(key, value); }
+bool KVStorage::Put(std::string_view key, std::string_view value, bool sync) { return impl_->Put(key, value, sync); }
 
 KVStorage::ErrorCode KVStorage::Get(std::string_view key, std::string* value) const { return impl_->Get(key, value); }
 
+bool KVStorage::PutBatch(const std::vector<std::pair<std::string, std::string_view>>& kvs, bool sync) {
+  return impl_->PutBatch(kvs, sync);
+}
+
+void KVStorage::MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                         std::vector<ErrorCode>* ecs) const {
+  impl_->MultiGet(keys, values, ecs);
+}
+
+bool KVStorage::Scan(std::string_view prefix,
+                     const std::function<bool(std::string_view key, std::string_view value)>& fn) const {
+  return impl_->Scan(prefix, fn);
+}
+
 }  // namespace vdb
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 namespace vdb {
 
@@ -35,8 +38,17 @@ class KVStorage {
   [[nodiscard]] bool Init(const std::string& path);
 
  public:
-  [[nodiscard]] bool Put(std::string_view key, std::string_view value);
+  // `sync` 为 true 时等 RocksDB 的 WAL 落盘后才返回
+  [[nodiscard]] bool Put(std::string_view key, std::string_view value, bool sync = false);
   [[nodiscard]] ErrorCode Get(std::string_view key, std::string* value) const;
+  // 所有键值在一个 `WriteBatch` 中原子写入
+  [[nodiscard]] bool PutBatch(const std::vector<std::pair<std::string, std::string_view>>& kvs, bool sync = false);
+  // `values`/`ecs` 与 `keys` 一一对应
+  void MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                std::vector<ErrorCode>* ecs) const;
+  // 按键的顺序遍历以 `prefix` 开头的键值，`fn` 返回 false 时停止并返回 false
+  [[nodiscard]] bool Scan(std::string_view prefix,
+                          const std::function<bool(std::string_view key, std::string_view value)>& fn) const;
 };
 
 }  // namespace vdb
@@ -2,10 +2,17 @@
 #include <errno.h>
 #include <glog/logging.h>
 #include <stddef.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <ios>
+#include <iterator>
+#include <mutex>
+#include <system_error>
+#include <vector>
 #include "util/util.h"
 
 namespace vdb {
@@ -18,6 +25,12 @@ namespace {
 const std::string WAL_LOG_FOLDER = "/wal/";
 const std::string KV_STORAGE_FOLDER = "/kv_storage/";
 const std::string SNAPSHOT_FOLDER = "/snapshot/";
+const std::string SNAPSHOT_TMP_FOLDER = "tmp";
+const std::string SNAPSHOT_BITMAP_FILE = "bitmap";
+const std::string SNAPSHOT_ID_MAP_FILE = "id_map";
+
+// 每条 WAL 记录中 TotalSize 之后、Data 之前的部分：LogID (8) + Version (1) + OP (1) + DataSize (8)
+const uint64_t WAL_LOG_HEADER_SIZE = 8 + 1 + 1 + 8;
 
 /************************************************************************/
 /* Inner key prefix of KV storage*/
@@ -28,8 +41,36 @@ const std::string EXTERNAL_PREFIX = "external/data/";
 /************************************************************************/
 /* Meta key of KV storage*/
 /************************************************************************/
-const std::string BITMAP_KEY = SNAPSHOT_PREFIX + "bitmap";
+// 旧版 snapshot 的元数据，只在没有 manifest 时读取
 const std::string LAST_SNAPSHOT_ID = SNAPSHOT_PREFIX + "last_snapshot_id";
+// 已发布 snapshot 的 id，对应目录 `snapshot/<id>/`
+const std::string MANIFEST_KEY = SNAPSHOT_PREFIX + "manifest";
+
+std::string SnapshotDirName(uint64_t snapshot_id) {
+  std::string name = std::to_string(snapshot_id);
+  return std::string(20 - std::min<size_t>(name.size(), 20), '0') + name;
+}
+
+// manifest 与旧版 last_snapshot_id 都是十进制的 log_id，内容损坏时返回 false
+bool ParseSnapshotId(const std::string& str, uint64_t* snapshot_id) {
+  auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), *snapshot_id);
+  return ec == std::errc() && ptr == str.data() + str.size() && !str.empty();
+}
+
+bool WriteFile(const fs::path& path, const std::string& data) {
+  std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  file.write(data.data(), data.size());
+  return file.good();
+}
+
+bool ReadFile(const fs::path& path, std::string* data) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  data->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return !file.bad();
+}
 
 }  // namespace
 
@@ -45,7 +86,24 @@ class Persistence::Impl {
   fs::path wal_path_;
   fs::path kv_storage_path_;
   fs::path snapshot_path_;
-  std::fstream wal_log_file_;
+  // 启动回放时只读；写入统一交给 `wal_writer_`
+  std::vector<WALSegment> wal_segments_;
+  bool wal_segments_loaded_{false};
+  size_t next_wal_segment_{0};
+  std::ifstream wal_log_file_;
+  // 当前回放段的大小与已读取的位置，用于识别段尾不完整的记录
+  uint64_t wal_file_size_{0};
+  uint64_t wal_file_offset_{0};
+  std::mutex wal_mutex_;
+  // 自启动以来写入（含回放）的 WAL 记录数与字节数；`*_mark_` 为上次 snapshot 时的值
+  uint64_t wal_records_{0};
+  uint64_t wal_bytes_{0};
+  uint64_t pending_records_mark_{0};
+  uint64_t pending_bytes_mark_{0};
+  uint64_t snapshot_records_mark_{0};
+  uint64_t snapshot_bytes_mark_{0};
+  std::chrono::steady_clock::time_point last_snapshot_time_{std::chrono::steady_clock::now()};
+  WALWriter wal_writer_;
 
   KVStorage kv_storage_;
 
@@ -57,8 +115,9 @@ class Persistence::Impl {
   }
 
  public:
-  bool Init(const std::string& path, uint8_t version) {
-    version_ = version;
+  bool Init(const InitOptions& opts) {
+    const std::string& path = opts.path;
+    version_ = opts.version;
     wal_path_ = path + WAL_LOG_FOLDER;
     kv_storage_path_ = path + KV_STORAGE_FOLDER;
     snapshot_path_ = path + SNAPSHOT_FOLDER;
@@ -76,10 +135,12 @@ class Persistence::Impl {
       return false;
     }
 
-    wal_log_file_.open(wal_path_.native() + "log.log", std::ios::in | std::ios::out | std::ios::app);
-    if (!wal_log_file_.is_open()) {
-      LOG(WARNING) << "Failed to open WAL log file, error=" << std::strerror(errno)
-                   << ",path=" << std::quoted(wal_path_.native()) << ".";
+    WALWriter::Options wal_opts;
+    wal_opts.dir = wal_path_.native();
+    wal_opts.sync_policy = opts.wal_sync_policy;
+    wal_opts.sync_interval_ms = opts.wal_sync_interval_ms;
+    wal_opts.segment_size = opts.wal_segment_size;
+    if (!wal_writer_.Init(wal_opts)) {
       return false;
     }
 
@@ -101,68 +162,139 @@ class Persistence::Impl {
    *
    */
   bool WriteWALLog(char op, const std::string& data) {
-    ++log_id_;
-
-    uint64_t total_size = 8 + 1 + 1 + 8 + data.size();
-    uint64_t data_size = data.size();
-    wal_log_file_.write((char*)&total_size, 8);
-    wal_log_file_.write((char*)&log_id_, 8);
-    wal_log_file_.write((char*)&version_, 1);
-    wal_log_file_.write((char*)&op, 1);
-    wal_log_file_.write((char*)&data_size, 8);
-    wal_log_file_.write(data.data(), data.size());
-
-    if (wal_log_file_.fail()) {
-      LOG(WARNING) << "An error occurred while writing the WAL log entry, error=" << std::strerror(errno) << ".";
+    uint64_t seq = 0;
+    return AppendWALLog(op, data, &seq) && SyncWALLog(seq);
+  }
+
+  bool AppendWALLog(char op, const std::string& data, uint64_t* seq) {
+    return AppendWALLogBatch(op, {data}, seq);
+  }
+
+  bool AppendWALLogBatch(char op, const std::vector<std::string_view>& datas, uint64_t* seq) {
+    size_t group_size = 0;
+    for (const auto& data : datas) {
+      group_size += 8 + 8 + 1 + 1 + 8 + data.size();
+    }
+    std::string group;
+    group.resize(group_size);
+
+    std::lock_guard lock(wal_mutex_);
+    uint64_t first_log_id = log_id_ + 1;
+    uint64_t log_id = log_id_;
+    size_t offset = 0;
+    for (const auto& data : datas) {
+      ++log_id;
+      uint64_t data_size = data.size();
+      uint64_t total_size = WAL_LOG_HEADER_SIZE + data_size;
+      std::memcpy(group.data() + offset, &total_size, 8);
+      offset += 8;
+      std::memcpy(group.data() + offset, &log_id, 8);
+      offset += 8;
+      std::memcpy(group.data() + offset, &version_, 1);
+      offset += 1;
+      std::memcpy(group.data() + offset, &op, 1);
+      offset += 1;
+      std::memcpy(group.data() + offset, &data_size, 8);
+      offset += 8;
+      std::memcpy(group.data() + offset, data.data(), data_size);
+      offset += data_size;
+    }
+
+    if (!wal_writer_.Append(group, first_log_id, seq)) {
+      LOG(WARNING) << "An error occurred while writing the WAL log entry, log_id=" << first_log_id << ".";
       return false;
-    } else {
-      LOG(INFO) << "Wrote WAL log entry: log_id=" << log_id_ << ",version=" << (int32_t)version_
-                << ",op=" << (int32_t)op << ",data=" << data << ".";
-      wal_log_file_.flush();
     }
+    log_id_ = log_id;
+    wal_records_ += datas.size();
+    wal_bytes_ += group.size();
+    VLOG(1) << "Wrote WAL log entries: first_log_id=" << first_log_id << ",last_log_id=" << log_id_
+            << ",version=" << (int32_t)version_ << ",op=" << (int32_t)op << ",group_size=" << group_size << ".";
     return true;
   }
 
-  LOG_STATUS ReadNextWALLog(char* op, std::string* data) {
-    LOG(INFO) << "Reading next WAL log entry";
-
-    uint64_t total_size = 0;
-    while (wal_log_file_.read((char*)&total_size, 8)) {
-      std::string buf;
-      buf.resize(total_size);
-      wal_log_file_.read(buf.data(), total_size);
-      size_t offset = 0;
+  bool SyncWALLog(uint64_t seq) {
+    if (!wal_writer_.Wait(seq)) {
+      LOG(WARNING) << "Failed to sync WAL log entry, seq=" << seq << ".";
+      return false;
+    }
+    return true;
+  }
 
-      uint64_t log_id;
-      std::memcpy(&log_id, buf.data() + offset, 8);
-      offset += 8;
+  LOG_STATUS ReadNextWALLog(char* op, uint8_t* version, std::string* data) {
+    VLOG(1) << "Reading next WAL log entry";
+    if (!wal_segments_loaded_ && !LoadWALSegments()) {
+      return LOG_STATUS::LS_ERROR;
+    }
 
-      if (log_id > log_id_) {
-        log_id_ = log_id;
+    while (true) {
+      if (!wal_log_file_.is_open()) {
+        auto st = OpenNextWALSegment();
+        if (st == LOG_STATUS::LS_END) {
+          break;
+        }
+        if (st == LOG_STATUS::LS_ERROR) {
+          return st;
+        }
       }
 
-      if (log_id_ <= last_snapshot_id_) {
-        LOG(INFO) << "Skip WAL log entry: log_id=" << log_id << ",last_snapshot_id=" << last_snapshot_id_ << ".";
-        continue;
+      uint64_t total_size = 0;
+      while (wal_log_file_.read((char*)&total_size, 8)) {
+        wal_file_offset_ += 8;
+        // 崩溃时段尾的记录可能只写了一半，或是文件已扩展而内容未落盘的全零数据，长度不合法时视为该段结尾
+        if (total_size < WAL_LOG_HEADER_SIZE || total_size > wal_file_size_ - wal_file_offset_) {
+          LOG(WARNING) << "Truncated WAL log entry at the end, total_size=" << total_size
+                       << ",offset=" << wal_file_offset_ - 8 << ",file_size=" << wal_file_size_ << ".";
+          break;
+        }
+        std::string buf;
+        buf.resize(total_size);
+        if (!wal_log_file_.read(buf.data(), total_size)) {
+          LOG(WARNING) << "Truncated WAL log entry at the end, total_size=" << total_size << ".";
+          break;
+        }
+        wal_file_offset_ += total_size;
+        uint64_t data_size = 0;
+        std::memcpy(&data_size, buf.data() + WAL_LOG_HEADER_SIZE - 8, 8);
+        if (data_size != total_size - WAL_LOG_HEADER_SIZE) {
+          LOG(WARNING) << "Corrupted WAL log entry, treated as the end of segment, total_size=" << total_size
+                       << ",data_size=" << data_size << ".";
+          break;
+        }
+        size_t offset = 0;
+
+        uint64_t log_id;
+        std::memcpy(&log_id, buf.data() + offset, 8);
+        offset += 8;
+
+        if (log_id > log_id_) {
+          log_id_ = log_id;
+        }
+
+        if (log_id_ <= last_snapshot_id_) {
+          VLOG(1) << "Skip WAL log entry: log_id=" << log_id << ",last_snapshot_id=" << last_snapshot_id_ << ".";
+          continue;
+        }
+
+        // 每条记录自带版本号，回放时按记录的版本解码，不覆盖当前写入版本
+        std::memcpy(version, buf.data() + offset, 1);
+        offset += 1;
+
+        std::memcpy(op, buf.data() + offset, 1);
+        offset += 1;
+        // DataSize 已校验
+        offset += 8;
+
+        data->assign(buf.data() + offset, data_size);
+        ++wal_records_;
+        wal_bytes_ += 8 + total_size;
+        VLOG(1) << "Read WAL log entry: log_id=" << log_id_ << ",version=" << (int32_t)(*version)
+                << ",op=" << (int32_t)(*op) << ",data_size=" << data_size << ".";
+
+        return LOG_STATUS::LS_OK;
       }
-
-      std::memcpy(&version_, buf.data() + offset, 1);
-      offset += 1;
-
-      std::memcpy(op, buf.data() + offset, 1);
-      offset += 1;
-      uint64_t data_size = 0;
-      std::memcpy(&data_size, buf.data() + offset, 8);
-      offset += 8;
-
-      data->assign(buf.data() + offset, data_size);
-      LOG(INFO) << "Read WAL log entry: log_id=" << log_id_ << ",version=" << (int32_t)version_
-                << ",op=" << (int32_t)(*op) << ",data=" << *data << ".";
-
-      return LOG_STATUS::LS_OK;
+      wal_log_file_.close();
     }
 
-    wal_log_file_.clear();
     LOG(INFO) << "No more WAL log entries to read";
     return LOG_STATUS::LS_END;
   }
@@ -177,64 +309,279 @@ class Persistence::Impl {
     return kv_storage_.Get(encode_key, value);
   }
 
-  // TODO(cong): 原子性？
-  bool SaveSnapshot(IndexFactory* index_factory, FieldBitmap* bitmap) {
+  bool PutBatch(const std::vector<std::pair<std::string, std::string_view>>& kvs) {
+    std::vector<std::pair<std::string, std::string_view>> encode_kvs;
+    encode_kvs.reserve(kvs.size());
+    for (const auto& [key, value] : kvs) {
+      encode_kvs.emplace_back(EXTERNAL_PREFIX + key, value);
+    }
+    return kv_storage_.PutBatch(encode_kvs);
+  }
+
+  void MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                std::vector<KVStorage::ErrorCode>* ecs) const {
+    std::vector<std::string> encode_keys;
+    encode_keys.reserve(keys.size());
+    for (const auto& key : keys) {
+      encode_keys.push_back(EXTERNAL_PREFIX + key);
+    }
+    kv_storage_.MultiGet(encode_keys, values, ecs);
+  }
+
+  bool Scan(const std::function<bool(std::string_view, std::string_view)>& fn) const {
+    return kv_storage_.Scan(EXTERNAL_PREFIX, [&](std::string_view key, std::string_view value) {
+      return fn(key.substr(EXTERNAL_PREFIX.size()), value);
+    });
+  }
+
+  // 在写锁内调用：确定 snapshot 点
+  void BeginSnapshot(uint64_t* snapshot_id) {
     LOG(INFO) << "Start to saving snapshot.";
-    last_snapshot_id_ = log_id_;
+    std::lock_guard lock(wal_mutex_);
+    *snapshot_id = log_id_;
+    pending_records_mark_ = wal_records_;
+    pending_bytes_mark_ = wal_bytes_;
+  }
 
-    if (!index_factory->SaveIndex(snapshot_path_)) {
-      LOG(WARNING) << "Failed to save index.";
-      return false;
+  // 可在写锁外调用：所有文件写入临时目录并落盘后原子 rename 为 `snapshot/<id>/`，再以一次 manifest 写入发布。
+  // 各部分与写请求并发序列化，内容是 snapshot 点之后某一时刻的状态；从 snapshot 点起的 WAL 回放按顺序重新应用
+  // 这些写入，结果与原来一致。id 映射最后序列化，位图与索引中出现的内部 id 都已在其中，回放不会重新分配
+  bool CommitSnapshot(uint64_t snapshot_id, const IndexFactory& index_factory, const FieldBitmap& bitmap,
+                      const IdMap& id_map) {
+    fs::path tmp_path = snapshot_path_ / SNAPSHOT_TMP_FOLDER;
+    fs::path dst_path = snapshot_path_ / SnapshotDirName(snapshot_id);
+    std::error_code ec;
+    if (snapshot_id == last_snapshot_id_ && fs::is_directory(dst_path, ec)) {
+      LOG(INFO) << "No new WAL log entries since last snapshot, last_snapshot_id=" << last_snapshot_id_ << ".";
+      std::lock_guard lock(wal_mutex_);
+      last_snapshot_time_ = std::chrono::steady_clock::now();
+      return true;
     }
 
-    if (!kv_storage_.Put(BITMAP_KEY, bitmap->SerializeToString())) {
+    fs::remove_all(tmp_path, ec);
+    if (!fs::create_directories(tmp_path, ec)) {
+      LOG(WARNING) << "Failed to create snapshot tmp path=" << std::quoted(tmp_path.native())
+                   << ",error=" << ec.message() << ".";
+      return false;
+    }
+    if (!WriteFile(tmp_path / SNAPSHOT_BITMAP_FILE, bitmap.SerializeToString())) {
       LOG(WARNING) << "Failed to save bitmap.";
       return false;
     }
+    bool ok = index_factory.SerializeIndex([&tmp_path](const IndexFiles& files) {
+      for (const auto& [name, data] : files) {
+        if (!WriteFile(tmp_path / name, data)) {
+          LOG(WARNING) << "Failed to save index file=" << std::quoted(name) << ".";
+          return false;
+        }
+      }
+      return true;
+    });
+    if (!ok) {
+      return false;
+    }
+    if (!WriteFile(tmp_path / SNAPSHOT_ID_MAP_FILE, id_map.SerializeToString())) {
+      LOG(WARNING) << "Failed to save id map.";
+      return false;
+    }
+    for (const auto& entry : fs::directory_iterator(tmp_path, ec)) {
+      if (!SyncPath(entry.path())) {
+        LOG(WARNING) << "Failed to sync snapshot file=" << std::quoted(entry.path().native()) << ".";
+        return false;
+      }
+    }
+    if (ec || !SyncPath(tmp_path)) {
+      LOG(WARNING) << "Failed to sync snapshot tmp path=" << std::quoted(tmp_path.native()) << ".";
+      return false;
+    }
 
-    std::string id_str = std::to_string(last_snapshot_id_);
-    if (!kv_storage_.Put(LAST_SNAPSHOT_ID, id_str)) {
-      LOG(WARNING) << "Failed to save last_snapshot_id.";
+    fs::remove_all(dst_path, ec);
+    fs::rename(tmp_path, dst_path, ec);
+    if (ec || !SyncPath(snapshot_path_)) {
+      LOG(WARNING) << "Failed to publish snapshot path=" << std::quoted(dst_path.native()) << ",error=" << ec.message()
+                   << ".";
       return false;
     }
 
+    if (!kv_storage_.Put(MANIFEST_KEY, std::to_string(snapshot_id), true)) {
+      LOG(WARNING) << "Failed to save snapshot manifest.";
+      return false;
+    }
+    last_snapshot_id_ = snapshot_id;
+    {
+      std::lock_guard lock(wal_mutex_);
+      snapshot_records_mark_ = pending_records_mark_;
+      snapshot_bytes_mark_ = pending_bytes_mark_;
+      last_snapshot_time_ = std::chrono::steady_clock::now();
+    }
     LOG(INFO) << "Finish to saving snapshot, last_snapshot_id=" << last_snapshot_id_;
+
+    RemoveStaleSnapshots(dst_path);
+    TruncateWALLog(last_snapshot_id_);
     return true;
   }
 
-  bool LoadSnapshot(IndexFactory* index_factory, FieldBitmap* bitmap) {
+  void GetWALStats(WALStats* stats) {
+    std::lock_guard lock(wal_mutex_);
+    stats->records = wal_records_ - snapshot_records_mark_;
+    stats->bytes = wal_bytes_ - snapshot_bytes_mark_;
+    stats->seconds_since_snapshot =
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - last_snapshot_time_)
+            .count();
+  }
+
+  bool LoadSnapshot(IndexFactory* index_factory, FieldBitmap* bitmap, IdMap* id_map, bool* rebuild) {
     LOG(INFO) << "Start to loading snapshot.";
+    *rebuild = false;
 
-    if (!index_factory->LoadIndex(snapshot_path_)) {
-      LOG(WARNING) << "Failed to load index.";
+    std::string manifest;
+    auto ec = kv_storage_.Get(MANIFEST_KEY, &manifest);
+    if (ec == KVStorage::EC_Undefined) {
+      LOG(WARNING) << "Failed to get snapshot manifest.";
       return false;
     }
+    if (ec == KVStorage::EC_NotFound) {
+      *rebuild = true;
+      return LoadLegacySnapshot();
+    }
 
-    std::string bitmap_value;
-    auto ec = kv_storage_.Get(BITMAP_KEY, &bitmap_value);
-    if (ec == KVStorage::EC_Undefined) {
-      LOG(WARNING) << "Failed to get bitmap.";
+    uint64_t snapshot_id = 0;
+    if (!ParseSnapshotId(manifest, &snapshot_id)) {
+      LOG(WARNING) << "Invalid snapshot manifest, value=" << std::quoted(manifest) << ".";
       return false;
     }
-    if (ec == KVStorage::EC_OK && !bitmap->ParseFromString(bitmap_value)) {
-      LOG(WARNING) << "Failed to parse bitmap.";
-      return false;
+    fs::path path = snapshot_path_ / SnapshotDirName(snapshot_id);
+    std::error_code exists_ec;
+    if (!fs::exists(path / SNAPSHOT_ID_MAP_FILE, exists_ec)) {
+      LOG(INFO) << "Snapshot has no id map, rebuild from storage, snapshot_id=" << snapshot_id << ".";
+      *rebuild = true;
+    } else {
+      if (!index_factory->LoadIndex(path)) {
+        LOG(WARNING) << "Failed to load index.";
+        return false;
+      }
+
+      std::string bitmap_value;
+      if (!ReadFile(path / SNAPSHOT_BITMAP_FILE, &bitmap_value) || !bitmap->ParseFromString(bitmap_value)) {
+        LOG(WARNING) << "Failed to load bitmap.";
+        return false;
+      }
+
+      std::string id_map_value;
+      if (!ReadFile(path / SNAPSHOT_ID_MAP_FILE, &id_map_value) || !id_map->ParseFromString(id_map_value)) {
+        LOG(WARNING) << "Failed to load id map.";
+        return false;
+      }
     }
 
+    last_snapshot_id_ = snapshot_id;
+    // 被 snapshot 覆盖的段可能已删除，log_id 至少从 snapshot 之后开始分配
+    log_id_ = std::max(log_id_, last_snapshot_id_);
+    LOG(INFO) << "Finish to loading snapshot, last_snapshot_id=" << last_snapshot_id_;
+    return true;
+  }
+
+ private:
+  // 旧版 snapshot 中的索引与位图使用外部 id，不再加载，只读取 WAL 回放的起点
+  bool LoadLegacySnapshot() {
     std::string last_snapshot_id_value;
-    ec = kv_storage_.Get(LAST_SNAPSHOT_ID, &last_snapshot_id_value);
+    auto ec = kv_storage_.Get(LAST_SNAPSHOT_ID, &last_snapshot_id_value);
     if (ec == KVStorage::EC_Undefined) {
       LOG(WARNING) << "Failed to get last_snapshot_id.";
       return false;
     }
     if (ec == KVStorage::EC_OK) {
-      LOG(INFO) << "dd:" << last_snapshot_id_value;
-      last_snapshot_id_ = std::stol(last_snapshot_id_value);
+      if (!ParseSnapshotId(last_snapshot_id_value, &last_snapshot_id_)) {
+        LOG(WARNING) << "Invalid last_snapshot_id, value=" << std::quoted(last_snapshot_id_value) << ".";
+        return false;
+      }
+      log_id_ = std::max(log_id_, last_snapshot_id_);
     }
 
-    LOG(INFO) << "Finish to loading snapshot, last_snapshot_id=" << last_snapshot_id_;
+    LOG(INFO) << "Finish to loading legacy snapshot, last_snapshot_id=" << last_snapshot_id_;
+    return true;
+  }
+
+  // 删除除 `current` 外的所有 snapshot 目录以及旧版直接放在 `snapshot/` 下的索引文件
+  void RemoveStaleSnapshots(const fs::path& current) {
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(snapshot_path_, ec)) {
+      if (entry.path() == current) {
+        continue;
+      }
+      fs::remove_all(entry.path(), ec);
+      if (ec) {
+        LOG(WARNING) << "Failed to remove stale snapshot path=" << std::quoted(entry.path().native())
+                     << ",error=" << ec.message() << ".";
+      }
+    }
+  }
+
+  // 从最后一个起始 log_id <= last_snapshot_id_ + 1 的段开始回放，之前的段已全部被 snapshot 覆盖
+  bool LoadWALSegments() {
+    if (!ListWALSegments(wal_path_.native(), &wal_segments_)) {
+      return false;
+    }
+    wal_segments_loaded_ = true;
+    next_wal_segment_ = 0;
+    for (size_t i = 0; i < wal_segments_.size(); ++i) {
+      if (wal_segments_[i].start_log_id <= last_snapshot_id_ + 1) {
+        next_wal_segment_ = i;
+      }
+    }
+    LOG(INFO) << "Found WAL segments, total=" << wal_segments_.size() << ",skipped=" << next_wal_segment_
+              << ",last_snapshot_id=" << last_snapshot_id_ << ".";
     return true;
   }
+
+  LOG_STATUS OpenNextWALSegment() {
+    if (next_wal_segment_ >= wal_segments_.size()) {
+      return LOG_STATUS::LS_END;
+    }
+    const auto& segment = wal_segments_[next_wal_segment_++];
+    wal_log_file_.open(segment.path, std::ios::in | std::ios::binary);
+    std::error_code ec;
+    wal_file_size_ = fs::file_size(segment.path, ec);
+    if (!wal_log_file_.is_open() || ec) {
+      LOG(WARNING) << "Failed to open WAL segment, error=" << (ec ? ec.message() : std::strerror(errno))
+                   << ",path=" << std::quoted(segment.path) << ".";
+      return LOG_STATUS::LS_ERROR;
+    }
+    wal_file_offset_ = 0;
+    if (!segment.legacy) {
+      // 段头没写完就崩溃时读取失败，后续读取直接落到该段结尾
+      std::string header(WAL_SEGMENT_HEADER_SIZE, '\0');
+      uint64_t start_log_id = 0;
+      if (!wal_log_file_.read(header.data(), header.size()) || !ParseWALSegmentHeader(header, &start_log_id)) {
+        LOG(WARNING) << "Invalid WAL segment header, path=" << std::quoted(segment.path) << ".";
+        wal_log_file_.setstate(std::ios::failbit);
+      }
+      wal_file_offset_ = header.size();
+    }
+    LOG(INFO) << "Reading WAL segment, path=" << std::quoted(segment.path) << ".";
+    return LOG_STATUS::LS_OK;
+  }
+
+  // 删除完全被 snapshot 覆盖的段：下一段的起始 log_id <= snapshot_id + 1，当前写入的最后一段始终保留
+  void TruncateWALLog(uint64_t snapshot_id) {
+    std::vector<WALSegment> segments;
+    if (!ListWALSegments(wal_path_.native(), &segments)) {
+      return;
+    }
+    for (size_t i = 0; i + 1 < segments.size(); ++i) {
+      if (segments[i + 1].start_log_id > snapshot_id + 1) {
+        break;
+      }
+      std::error_code ec;
+      if (!fs::remove(segments[i].path, ec)) {
+        LOG(WARNING) << "Failed to remove WAL segment, error=" << ec.message()
+                     << ",path=" << std::quoted(segments[i].path) << ".";
+        break;
+      }
+      LOG(INFO) << "Removed WAL segment, path=" << std::quoted(segments[i].path) << ",snapshot_id=" << snapshot_id
+                << ".";
+    }
+  }
 };
 
 /************************************************************************/
@@ -244,24 +591,52 @@ Persistence::Persistence() : impl_(std::make_unique<Impl>()) {}
 
 Persistence::~Persistence() = default;
 
-bool Persistence::Init(const std::string& path, uint8_t version) { return impl_->Init(path, version); }
+bool Persistence::Init(const InitOptions& opts) { return impl_->Init(opts); }
 
 bool Persistence::WriteWALLog(char op, const std::string& data) { return impl_->WriteWALLog(op, data); }
 
-Persistence::LOG_STATUS Persistence::ReadNextWALLog(char* op, std::string* data) {
-  return impl_->ReadNextWALLog(op, data);
+bool Persistence::AppendWALLog(char op, const std::string& data, uint64_t* seq) {
+  return impl_->AppendWALLog(op, data, seq);
+}
+
+bool Persistence::AppendWALLogBatch(char op, const std::vector<std::string_view>& datas, uint64_t* seq) {
+  return impl_->AppendWALLogBatch(op, datas, seq);
+}
+
+bool Persistence::SyncWALLog(uint64_t seq) { return impl_->SyncWALLog(seq); }
+
+Persistence::LOG_STATUS Persistence::ReadNextWALLog(char* op, uint8_t* version, std::string* data) {
+  return impl_->ReadNextWALLog(op, version, data);
 }
 
 bool Persistence::Put(std::string_view key, std::string_view value) { return impl_->Put(key, value); }
 
 KVStorage::ErrorCode Persistence::Get(std::string_view key, std::string* value) const { return impl_->Get(key, value); }
 
-bool Persistence::SaveSnapshot(IndexFactory* index_factory, FieldBitmap* bitmap) {
-  return impl_->SaveSnapshot(index_factory, bitmap);
+bool Persistence::PutBatch(const std::vector<std::pair<std::string, std::string_view>>& kvs) {
+  return impl_->PutBatch(kvs);
 }
 
-bool Persistence::LoadSnapshot(IndexFactory* index_factory, FieldBitmap* bitmap) {
-  return impl_->LoadSnapshot(index_factory, bitmap);
+void Persistence::MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                           std::vector<KVStorage::ErrorCode>* ecs) const {
+  impl_->MultiGet(keys, values, ecs);
+}
+
+bool Persistence::Scan(const std::function<bool(std::string_view key, std::string_view value)>& fn) const {
+  return impl_->Scan(fn);
+}
+
+void Persistence::BeginSnapshot(uint64_t* snapshot_id) { impl_->BeginSnapshot(snapshot_id); }
+
+bool Persistence::CommitSnapshot(uint64_t snapshot_id, const IndexFactory& index_factory, const FieldBitmap& bitmap,
+                                 const IdMap& id_map) {
+  return impl_->CommitSnapshot(snapshot_id, index_factory, bitmap, id_map);
+}
+
+void Persistence::GetWALStats(WALStats* stats) { impl_->GetWALStats(stats); }
+
+bool Persistence::LoadSnapshot(IndexFactory* index_factory, FieldBitmap* bitmap, IdMap* id_map, bool* rebuild) {
+  return impl_->LoadSnapshot(index_factory, bitmap, id_map, rebuild);
 }
 
 }  // namespace vdb
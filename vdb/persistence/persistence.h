@@ -1,12 +1,17 @@
 #pragma once
 
 #include <stdint.h>
+#include <functional>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 #include "bitmap/field_bitmap.h"
+#include "index/id_map.h"
 #include "index/index_factory.h"
 #include "persistence/kv_storage.h"
+#include "persistence/wal.h"
 #if defined __GLIBCXX__ && __GNUC__ <= 7
 #include <experimental/filesystem>
 namespace fs = std::experimental::filesystem;
@@ -21,6 +26,23 @@ namespace vdb {
 /* Persistence */
 /************************************************************************/
 class Persistence {
+ public:
+  struct InitOptions {
+    std::string path;
+    uint8_t version{0};
+    WALWriter::SyncPolicy wal_sync_policy{WALWriter::SP_PER_REQUEST};
+    int wal_sync_interval_ms{10};
+    size_t wal_segment_size{64 << 20};
+  };
+
+ public:
+  // 上次 snapshot 之后新增的 WAL
+  struct WALStats {
+    uint64_t records{0};
+    uint64_t bytes{0};
+    int64_t seconds_since_snapshot{0};
+  };
+
  public:
   enum LOG_STATUS {
     LS_OK = 0,
@@ -43,19 +65,36 @@ class Persistence {
   Persistence& operator=(Persistence&&) = delete;
 
  public:
-  [[nodiscard]] bool Init(const std::string& path, uint8_t version);
+  [[nodiscard]] bool Init(const InitOptions& opts);
 
  public:
   [[nodiscard]] bool WriteWALLog(char op, const std::string& data);
-  [[nodiscard]] LOG_STATUS ReadNextWALLog(char* op, std::string* data);
+  // 两阶段写入：`AppendWALLog` 分配 log_id 并入队，`SyncWALLog` 等待其所在的组落盘
+  [[nodiscard]] bool AppendWALLog(char op, const std::string& data, uint64_t* seq);
+  // 多条记录作为同一组追加，只需一次 `SyncWALLog`
+  [[nodiscard]] bool AppendWALLogBatch(char op, const std::vector<std::string_view>& datas, uint64_t* seq);
+  [[nodiscard]] bool SyncWALLog(uint64_t seq);
+  [[nodiscard]] LOG_STATUS ReadNextWALLog(char* op, uint8_t* version, std::string* data);
 
  public:
   [[nodiscard]] bool Put(std::string_view key, std::string_view value);
   [[nodiscard]] KVStorage::ErrorCode Get(std::string_view key, std::string* value) const;
+  [[nodiscard]] bool PutBatch(const std::vector<std::pair<std::string, std::string_view>>& kvs);
+  void MultiGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                std::vector<KVStorage::ErrorCode>* ecs) const;
+  // 遍历所有标量数据，`key` 为去掉内部前缀后的键
+  [[nodiscard]] bool Scan(const std::function<bool(std::string_view key, std::string_view value)>& fn) const;
 
  public:
-  [[nodiscard]] bool SaveSnapshot(IndexFactory* index_factory, FieldBitmap* bitmap);
-  [[nodiscard]] bool LoadSnapshot(IndexFactory* index_factory, FieldBitmap* bitmap);
+  // 两阶段 snapshot：`BeginSnapshot` 需与写请求互斥，只确定 snapshot 点（WAL 回放的起点）；
+  // `CommitSnapshot` 在各自的锁下序列化位图、索引与 id 映射并写文件、落盘与发布，可与写请求并发
+  void BeginSnapshot(uint64_t* snapshot_id);
+  [[nodiscard]] bool CommitSnapshot(uint64_t snapshot_id, const IndexFactory& index_factory, const FieldBitmap& bitmap,
+                                    const IdMap& id_map);
+  // 没有 id 映射的旧 snapshot 中，索引 label 与位图都是外部 id，此时只恢复 WAL 回放的起点，
+  // 不加载索引与位图，`rebuild` 置为 true，由调用方从 KV 中的标量数据重建
+  [[nodiscard]] bool LoadSnapshot(IndexFactory* index_factory, FieldBitmap* bitmap, IdMap* id_map, bool* rebuild);
+  void GetWALStats(WALStats* stats);
 };
 
 }  // namespace vdb
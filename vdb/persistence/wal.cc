@@ -0,0 +1,282 @@
+#include "persistence/wal.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include "util/util.h"
+
+namespace vdb {
+
+namespace {
+
+const char WAL_SEGMENT_MAGIC[4] = {'V', 'W', 'A', 'L'};
+const std::string WAL_SEGMENT_SUFFIX = ".wal";
+const size_t WAL_SEGMENT_NAME_DIGITS = 20;
+const std::string LEGACY_WAL_LOG_FILE = "log.log";
+
+std::string WALSegmentPath(const std::string& dir, uint64_t start_log_id) {
+  char name[WAL_SEGMENT_NAME_DIGITS + 1];
+  std::snprintf(name, sizeof(name), "%020lu", (unsigned long)start_log_id);
+  return dir + name + WAL_SEGMENT_SUFFIX;
+}
+
+bool ParseWALSegmentName(const std::string& name, uint64_t* start_log_id) {
+  if (name.size() != WAL_SEGMENT_NAME_DIGITS + WAL_SEGMENT_SUFFIX.size() ||
+      name.compare(WAL_SEGMENT_NAME_DIGITS, std::string::npos, WAL_SEGMENT_SUFFIX) != 0) {
+    return false;
+  }
+  uint64_t id = 0;
+  for (size_t i = 0; i < WAL_SEGMENT_NAME_DIGITS; ++i) {
+    if (name[i] < '0' || name[i] > '9') {
+      return false;
+    }
+    id = id * 10 + (name[i] - '0');
+  }
+  *start_log_id = id;
+  return true;
+}
+
+}  // namespace
+
+/************************************************************************/
+/* WAL segment */
+/************************************************************************/
+bool ListWALSegments(const std::string& dir, std::vector<WALSegment>* segments) {
+  segments->clear();
+  DIR* d = ::opendir(dir.c_str());
+  if (!d) {
+    LOG(WARNING) << "Failed to open WAL dir, error=" << std::strerror(errno) << ",path=" << std::quoted(dir) << ".";
+    return false;
+  }
+  while (struct dirent* entry = ::readdir(d)) {
+    std::string name = entry->d_name;
+    WALSegment segment;
+    if (name == LEGACY_WAL_LOG_FILE) {
+      segment.legacy = true;
+    } else if (!ParseWALSegmentName(name, &segment.start_log_id)) {
+      continue;
+    }
+    segment.path = dir + name;
+    segments->push_back(std::move(segment));
+  }
+  ::closedir(d);
+
+  std::sort(segments->begin(), segments->end(), [](const WALSegment& a, const WALSegment& b) {
+    return a.start_log_id < b.start_log_id;
+  });
+  return true;
+}
+
+/**
+ *
+ * Format of segment header:
+ * ----------------------------------------------------------------------------
+ * | Magic (4) | StartLogID (8) |
+ * ----------------------------------------------------------------------------
+ *
+ */
+bool ParseWALSegmentHeader(const std::string& header, uint64_t* start_log_id) {
+  if (header.size() != WAL_SEGMENT_HEADER_SIZE ||
+      std::memcmp(header.data(), WAL_SEGMENT_MAGIC, sizeof(WAL_SEGMENT_MAGIC)) != 0) {
+    return false;
+  }
+  std::memcpy(start_log_id, header.data() + sizeof(WAL_SEGMENT_MAGIC), 8);
+  return true;
+}
+
+/************************************************************************/
+/* WALWriter::Impl */
+/************************************************************************/
+class WALWriter::Impl {
+ private:
+  Options opts_;
+  int fd_{-1};
+  size_t segment_bytes_{0};
+
+  std::mutex mutex_;
+  std::condition_variable pending_cv_;
+  std::condition_variable synced_cv_;
+  std::string pending_;
+  uint64_t pending_first_log_id_{0};
+  uint64_t appended_seq_{0};
+  uint64_t synced_seq_{0};
+  // 第一个写失败的序号，之后的记录全部视为失败
+  uint64_t failed_seq_{std::numeric_limits<uint64_t>::max()};
+  bool stopped_{false};
+  std::thread thread_;
+
+ public:
+  ~Impl() {
+    {
+      std::lock_guard lock(mutex_);
+      stopped_ = true;
+    }
+    pending_cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+ public:
+  // 段文件在第一次写入时才创建，此时回放已结束，起始 log_id 已确定
+  bool Init(const Options& opts) {
+    opts_ = opts;
+    thread_ = std::thread([this] { Run(); });
+    return true;
+  }
+
+  bool Append(const std::string& record, uint64_t log_id, uint64_t* seq) {
+    {
+      std::lock_guard lock(mutex_);
+      if (failed_seq_ <= appended_seq_ || stopped_) {
+        return false;
+      }
+      if (pending_.empty()) {
+        pending_first_log_id_ = log_id;
+      }
+      pending_.append(record);
+      *seq = ++appended_seq_;
+    }
+    pending_cv_.notify_one();
+    return true;
+  }
+
+  bool Wait(uint64_t seq) {
+    std::unique_lock lock(mutex_);
+    synced_cv_.wait(lock, [&] { return synced_seq_ >= seq || failed_seq_ <= seq || stopped_; });
+    return synced_seq_ >= seq && seq < failed_seq_;
+  }
+
+ private:
+  void Run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+      if (opts_.sync_policy == SP_BATCH) {
+        pending_cv_.wait_for(lock, std::chrono::milliseconds(opts_.sync_interval_ms), [&] { return stopped_; });
+      }
+      pending_cv_.wait(lock, [&] { return stopped_ || !pending_.empty(); });
+      if (pending_.empty()) {
+        break;
+      }
+
+      std::string group;
+      group.swap(pending_);
+      uint64_t first_log_id = pending_first_log_id_;
+      uint64_t first_seq = synced_seq_ + 1;
+      uint64_t last_seq = appended_seq_;
+      lock.unlock();
+
+      bool ok = true;
+      if (fd_ < 0 || (segment_bytes_ > WAL_SEGMENT_HEADER_SIZE && segment_bytes_ + group.size() > opts_.segment_size)) {
+        ok = OpenSegment(first_log_id);
+      }
+      ok = ok && WriteAll(group);
+      // 写失败时段内实际长度未知，不计入；之后的写入都会失败，不会再据此换段
+      if (ok) {
+        segment_bytes_ += group.size();
+      }
+      if (ok && opts_.sync_policy != SP_NONE && ::fdatasync(fd_) != 0) {
+        LOG(WARNING) << "Failed to sync WAL log file, error=" << std::strerror(errno) << ".";
+        ok = false;
+      }
+
+      lock.lock();
+      if (!ok && failed_seq_ > first_seq) {
+        failed_seq_ = first_seq;
+      }
+      synced_seq_ = last_seq;
+      synced_cv_.notify_all();
+    }
+  }
+
+  bool OpenSegment(uint64_t start_log_id) {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+    std::string path = WALSegmentPath(opts_.dir, start_log_id);
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      LOG(WARNING) << "Failed to open WAL segment, error=" << std::strerror(errno) << ",path=" << std::quoted(path)
+                   << ".";
+      return false;
+    }
+
+    std::string header(WAL_SEGMENT_HEADER_SIZE, '\0');
+    std::memcpy(header.data(), WAL_SEGMENT_MAGIC, sizeof(WAL_SEGMENT_MAGIC));
+    std::memcpy(header.data() + sizeof(WAL_SEGMENT_MAGIC), &start_log_id, 8);
+    if (!WriteAll(header)) {
+      return false;
+    }
+    segment_bytes_ = header.size();
+    // 新段的目录项也要落盘，否则崩溃后整段可能丢失
+    if (opts_.sync_policy != SP_NONE && !SyncPath(opts_.dir)) {
+      LOG(WARNING) << "Failed to sync WAL dir, error=" << std::strerror(errno) << ".";
+      return false;
+    }
+    LOG(INFO) << "Opened WAL segment, path=" << std::quoted(path) << ".";
+    return true;
+  }
+
+  bool WriteAll(const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+      ssize_t n = ::write(fd_, data.data() + offset, data.size() - offset);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        LOG(WARNING) << "An error occurred while writing the WAL log group, error=" << std::strerror(errno) << ".";
+        return false;
+      }
+      offset += n;
+    }
+    return true;
+  }
+};
+
+/************************************************************************/
+/* WALWriter */
+/************************************************************************/
+WALWriter::WALWriter() : impl_(std::make_unique<Impl>()) {}
+
+WALWriter::~WALWriter() = default;
+
+bool WALWriter::Init(const Options& opts) { return impl_->Init(opts); }
+
+bool WALWriter::Append(const std::string& record, uint64_t log_id, uint64_t* seq) {
+  return impl_->Append(record, log_id, seq);
+}
+
+bool WALWriter::Wait(uint64_t seq) { return impl_->Wait(seq); }
+
+/************************************************************************/
+/* WALWriter functions */
+/************************************************************************/
+bool StringToSyncPolicy(const std::string& str, WALWriter::SyncPolicy* policy) {
+  if (str == "none") {
+    *policy = WALWriter::SP_NONE;
+  } else if (str == "batch") {
+    *policy = WALWriter::SP_BATCH;
+  } else if (str == "per-request") {
+    *policy = WALWriter::SP_PER_REQUEST;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace vdb
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vdb {
+
+/************************************************************************/
+/* WAL segment */
+/************************************************************************/
+struct WALSegment {
+  // 该段第一条记录的 log_id；旧版单文件 `log.log` 为 0
+  uint64_t start_log_id{0};
+  std::string path;
+  bool legacy{false};
+};
+
+// 段文件头的长度，旧版单文件没有段头
+const size_t WAL_SEGMENT_HEADER_SIZE = 4 + 8;
+
+// 按 `start_log_id` 升序列出 `dir` 下的所有段
+[[nodiscard]] bool ListWALSegments(const std::string& dir, std::vector<WALSegment>* segments);
+// 读取并校验段头，返回段的起始 log_id
+[[nodiscard]] bool ParseWALSegmentHeader(const std::string& header, uint64_t* start_log_id);
+
+/************************************************************************/
+/* WALWriter */
+/************************************************************************/
+// 组提交：并发追加的记录由后台线程合并为一次 `write` + 一次 `fdatasync`，
+// 调用方在 `Wait` 中阻塞直到所在的组落盘。
+// 每次启动后第一组写入以及当前段超过 `segment_size` 时都会切换到新段。
+class WALWriter {
+ public:
+  enum SyncPolicy {
+    SP_NONE = 0,         // 只写入 page cache，不 fsync
+    SP_BATCH = 1,        // 每 `sync_interval_ms` 刷盘一次
+    SP_PER_REQUEST = 2,  // 每组写完立即刷盘
+  };
+
+  struct Options {
+    std::string dir;
+    SyncPolicy sync_policy{SP_PER_REQUEST};
+    int sync_interval_ms{10};
+    size_t segment_size{64 << 20};
+  };
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+
+ public:
+  WALWriter();
+  ~WALWriter();
+
+ public:
+  WALWriter(const WALWriter&) = delete;
+  WALWriter(WALWriter&&) = delete;
+  WALWriter& operator=(const WALWriter&) = delete;
+  WALWriter& operator=(WALWriter&&) = delete;
+
+ public:
+  [[nodiscard]] bool Init(const Options& opts);
+
+ public:
+  // 追加一条已编码的记录，返回其组提交序号；`log_id` 需单调递增
+  [[nodiscard]] bool Append(const std::string& record, uint64_t log_id, uint64_t* seq);
+  // 阻塞直到 `seq` 所在的组写入完成（按 `SyncPolicy` 决定是否已 fsync）
+  [[nodiscard]] bool Wait(uint64_t seq);
+};
+
+/************************************************************************/
+/* WALWriter functions */
+/************************************************************************/
+[[nodiscard]] bool StringToSyncPolicy(const std::string& str, WALWriter::SyncPolicy* policy);
+
+}  // namespace vdb
@@ -1,5 +1,9 @@
 #include "server/server.h"
 #include <glog/logging.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include "gen_cpp/vdb.pb.h"
 #include "server/service.h"
 
@@ -8,6 +12,17 @@ namespace vdb {
 /************************************************************************/
 /* VdbServer */
 /************************************************************************/
+VdbServer::~VdbServer() {
+  {
+    std::lock_guard lock(scheduler_mutex_);
+    scheduler_stopped_ = true;
+  }
+  scheduler_cv_.notify_all();
+  if (scheduler_thread_.joinable()) {
+    scheduler_thread_.join();
+  }
+}
+
 bool VdbServer::Init(const InitOptions& opts) {
   if (!database_.Init(opts.db_opts)) {
     return false;
@@ -21,6 +36,56 @@ bool VdbServer::Init(const InitOptions& opts) {
     LOG(ERROR) << "Failed to add service";
     return false;
   }
+
+  snapshot_opts_ = opts.snapshot_opts;
+  if (snapshot_opts_.wal_bytes > 0 || snapshot_opts_.wal_records > 0 || snapshot_opts_.interval_s > 0) {
+    scheduler_thread_ = std::thread([this] { RunSnapshotScheduler(); });
+  }
+  return true;
+}
+
+void VdbServer::RunSnapshotScheduler() {
+  std::unique_lock lock(scheduler_mutex_);
+  while (!scheduler_cv_.wait_for(lock, std::chrono::milliseconds(snapshot_opts_.check_interval_ms),
+                                 [this] { return scheduler_stopped_; })) {
+    Database::SnapshotStats stats;
+    database_.GetSnapshotStats(&stats);
+    if (!ShouldSnapshot(stats)) {
+      continue;
+    }
+    LOG(INFO) << "Triggering automatic snapshot, wal_records=" << stats.wal_records
+              << ",wal_bytes=" << stats.wal_bytes << ",seconds_since_snapshot=" << stats.seconds_since_snapshot
+              << ".";
+    if (!database_.SaveSnapshot()) {
+      LOG(WARNING) << "Failed to start automatic snapshot.";
+    }
+  }
+}
+
+bool VdbServer::ShouldSnapshot(const Database::SnapshotStats& stats) const {
+  const auto& opts = snapshot_opts_;
+  if (stats.running || stats.wal_records == 0 || stats.seconds_since_snapshot < opts.min_interval_s) {
+    return false;
+  }
+
+  bool over_bytes = opts.wal_bytes > 0 && stats.wal_bytes >= opts.wal_bytes;
+  bool over_records = opts.wal_records > 0 && stats.wal_records >= opts.wal_records;
+  bool over_interval = opts.interval_s > 0 && stats.seconds_since_snapshot >= opts.interval_s;
+  if (!over_bytes && !over_records && !over_interval) {
+    return false;
+  }
+
+  // 负载高时推迟，但 WAL 过长会拖慢重启回放，超过两倍阈值时强制执行
+  double load = 0;
+  if (opts.max_load > 0 && ::getloadavg(&load, 1) == 1) {
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    bool urgent = (opts.wal_bytes > 0 && stats.wal_bytes >= 2 * opts.wal_bytes) ||
+                  (opts.wal_records > 0 && stats.wal_records >= 2 * opts.wal_records);
+    if (load / cores > opts.max_load && !urgent) {
+      VLOG(1) << "Defer automatic snapshot, load=" << load << ",cores=" << cores << ".";
+      return false;
+    }
+  }
   return true;
 }
 
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <brpc/server.h>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include "db/database.h"
 #include "server/service.h"
 
@@ -12,16 +15,42 @@ namespace vdb {
 /************************************************************************/
 class VdbServer : public brpc::Server {
  public:
+  // 自动 snapshot：任一阈值被超过即触发，阈值为 0 表示不启用该条件
+  struct SnapshotOptions {
+    uint64_t wal_bytes{0};
+    uint64_t wal_records{0};
+    int64_t interval_s{0};
+    // 两次 snapshot 的最小间隔
+    int64_t min_interval_s{60};
+    // 每核平均负载超过该值时推迟，直到 WAL 超过阈值的两倍；0 表示不检查
+    double max_load{0};
+    int check_interval_ms{1000};
+  };
+
   struct InitOptions {
     Database::InitOptions db_opts;
+    SnapshotOptions snapshot_opts;
   };
 
  private:
   std::unique_ptr<VdbServiceImpl> vdb_service_;
   Database database_;
 
+  SnapshotOptions snapshot_opts_;
+  std::mutex scheduler_mutex_;
+  std::condition_variable scheduler_cv_;
+  bool scheduler_stopped_{false};
+  std::thread scheduler_thread_;
+
+ public:
+  ~VdbServer() override;
+
  public:
   [[nodiscard]] bool Init(const InitOptions& opts);
+
+ private:
+  void RunSnapshotScheduler();
+  [[nodiscard]] bool ShouldSnapshot(const Database::SnapshotStats& stats) const;
 };
 
 }  // namespace vdb
@@ -1,13 +1,17 @@
 #include "server/service.h"
 #include <brpc/closure_guard.h>
 #include <brpc/controller.h>
+#include <bvar/bvar.h>
 #include <gen_cpp/vdb.pb.h>
 #include <glog/logging.h>
 #include <google/protobuf/stubs/status.h>
 #include <stddef.h>
 #include <sstream>
 #include <string>
+#include <vector>
+#include "bitmap/field_bitmap.h"
 #include "db/database.h"
+#include "index/index.h"
 #include "util/util.h"
 
 namespace vdb {
@@ -32,80 +36,120 @@ std::string ToString(const brpc::HttpHeader& request, const std::string& body) {
   return buf.str();
 }
 
-/************************************************************************/
-/* Handlers */
-/************************************************************************/
-struct ResponseMsg {
-  int ret_code = 0;
-  std::string msg;
+// 各执行方式的过滤搜索次数，可在 brpc 内置服务的 /vars 页面查看
+void CountFilterPlan(const std::string& plan) {
+  static bvar::Adder<int64_t> pre_filter("vdb_search_pre_filter_count");
+  static bvar::Adder<int64_t> in_filter("vdb_search_in_filter_count");
+  static bvar::Adder<int64_t> post_filter("vdb_search_post_filter_count");
+  if (plan == FilterPlanToString(FilterPlan::PRE_FILTER)) {
+    pre_filter << 1;
+  } else if (plan == FilterPlanToString(FilterPlan::IN_FILTER)) {
+    in_filter << 1;
+  } else if (plan == FilterPlanToString(FilterPlan::POST_FILTER)) {
+    post_filter << 1;
+  }
+}
 
-  ResponseMsg() = default;
-  template <typename Message>
-  // NOLINTNEXTLINE
-  ResponseMsg(const Message& m) : ret_code(m.ret_code()), msg(PbToJsonStr(m)) {}
-};
+// 请求中 `index_type` 为 uint32，需排除未设置（0）与枚举之外的值
+bool ValidateIndexType(uint32_t index_type) {
+  return index_type != service::IT_INVALID && index_type <= (uint32_t)service::IndexType_MAX &&
+         service::IndexType_IsValid((int)index_type);
+}
 
-ResponseMsg UpsertHandler(brpc::Controller* cntl, Database* database) {
-  service::UpsertRequest req;
-  service::EmptyResponse resp;
-  auto st = JsonStrToPb(cntl->request_attachment().to_string(), &req);
-  if (!st.ok()) {
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to parse http request");
-    return resp;
+bool ValidateTypedFields(const service::UpsertRequest& req) {
+  for (const auto& [field_name, value] : req.typed_fields()) {
+    if (!ValidateFieldValue(value)) {
+      return false;
+    }
   }
+  return true;
+}
 
-  if (req.vector().empty() || !req.index_type() || !req.id()) {
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to upsert, invalid params");
-    return resp;
-  }
+void CountFilterCache(bool hit) {
+  static bvar::Adder<int64_t> hits("vdb_filter_cache_hit_count");
+  static bvar::Adder<int64_t> misses("vdb_filter_cache_miss_count");
+  (hit ? hits : misses) << 1;
+}
 
-  if (!database->WriteWALLog(Database::WT_UPSERT, PbToJsonStr(req))) {
-    LOG(WARNING) << "Failed to write wal log.";
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to write wal log");
-    return resp;
+/************************************************************************/
+/* Processors */
+/************************************************************************/
+// 与协议无关的处理逻辑，HTTP/JSON 与二进制 RPC 共用
+void ProcessUpsert(Database* database, const service::UpsertRequest& req, service::EmptyResponse* resp) {
+  if (req.vector().empty() || !ValidateIndexType(req.index_type()) || !req.id() || !ValidateTypedFields(req)) {
+    resp->set_ret_code(400);
+    resp->set_msg("Failed to upsert, invalid params");
+    return;
   }
 
   Database::UpsertOptions opts;
   opts.id = req.id();
   opts.index_type = (service::IndexType)req.index_type();
   opts.data = req.vector().data();
+  opts.size = req.vector_size();
   opts.scalar_data = req.SerializeAsString();
-  opts.field = req.mutable_fields();
+  opts.field = &req.fields();
+  opts.typed_field = &req.typed_fields();
   if (!database->Upsert(opts)) {
     LOG(WARNING) << "Failed to upsert.";
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to upsert");
-    return resp;
+    resp->set_ret_code(400);
+    resp->set_msg("Failed to upsert");
+    return;
   }
 
-  resp.set_ret_code(200);
-  resp.set_msg("ok");
-  return resp;
+  resp->set_ret_code(200);
+  resp->set_msg("ok");
 }
 
-ResponseMsg SearchHandler(brpc::Controller* cntl, Database* database) {
-  service::SearchRequest req;
-  service::SearchResponse resp;
-  auto st = JsonStrToPb(cntl->request_attachment().to_string(), &req);
-  if (!st.ok()) {
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to parse http request");
-    return resp;
+void ProcessUpsertBatch(Database* database, const service::UpsertBatchRequest& req, service::EmptyResponse* resp) {
+  std::vector<Database::UpsertOptions> opts(req.items_size());
+  for (int i = 0; i < req.items_size(); ++i) {
+    const auto& item = req.items(i);
+    if (item.vector().empty() || !ValidateIndexType(item.index_type()) || !item.id() || !ValidateTypedFields(item)) {
+      resp->set_ret_code(400);
+      resp->set_msg("Failed to upsert batch, invalid params at item " + std::to_string(i));
+      return;
+    }
+    opts[i].id = item.id();
+    opts[i].index_type = (service::IndexType)item.index_type();
+    opts[i].data = item.vector().data();
+    opts[i].size = item.vector_size();
+    opts[i].scalar_data = item.SerializeAsString();
+    opts[i].field = &item.fields();
+    opts[i].typed_field = &item.typed_fields();
+  }
+  if (!database->UpsertBatch(opts)) {
+    LOG(WARNING) << "Failed to upsert batch.";
+    resp->set_ret_code(400);
+    resp->set_msg("Failed to upsert batch");
+    return;
   }
 
-  if (req.vector().empty() || !req.index_type() || !req.k()) {
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to search, invalid params");
-    return resp;
+  resp->set_ret_code(200);
+  resp->set_msg("ok");
+}
+
+void ProcessSearch(Database* database, const service::SearchRequest& req, service::SearchResponse* resp) {
+  if (req.vector().empty() || !ValidateIndexType(req.index_type()) || req.k() <= 0 || req.ef_search() < 0 ||
+      req.nprobe() < 0) {
+    resp->set_ret_code(400);
+    resp->set_msg("Failed to search, invalid params");
+    return;
   }
 
-  if (req.has_condition() && req.condition().op() != "=" && req.condition().op() != "!=") {
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to search, invalid filter op");
-    return resp;
+  // 旧的单个 `condition` 视为只有一个叶子的表达式
+  service::FilterExpression leaf;
+  const service::FilterExpression* filter = nullptr;
+  if (req.has_filter()) {
+    filter = &req.filter();
+  } else if (req.has_condition()) {
+    *leaf.mutable_condition() = req.condition();
+    filter = &leaf;
+  }
+  if (filter && !ValidateFilter(*filter)) {
+    resp->set_ret_code(400);
+    resp->set_msg("Failed to search, invalid filter");
+    return;
   }
 
   Database::SearchOptions opts;
@@ -113,63 +157,98 @@ ResponseMsg SearchHandler(brpc::Controller* cntl, Database* database) {
   opts.query = req.vector().data();
   opts.size = req.vector_size();
   opts.k = req.k();
-  opts.filter_field = req.condition().field();
-  opts.filter_op = req.condition().op();
-  opts.filter_value = req.condition().value();
+  opts.ef_search = req.ef_search();
+  opts.adaptive_ef = req.adaptive_ef();
+  opts.nprobe = req.nprobe();
+  opts.filter = filter;
   Database::SearchResult res;
   if (!database->Search(opts, &res)) {
     LOG(WARNING) << "Failed to search.";
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to search");
+    resp->set_ret_code(400);
+    resp->set_msg("Failed to search");
+    return;
   }
 
-  resp.set_ret_code(200);
-  resp.set_msg("ok");
-  for (size_t i = 0; i < res.indices.size(); ++i) {
-    if (res.indices[i] != -1) {
-      resp.mutable_indices()->Add(res.indices[i]);
-      resp.mutable_distances()->Add(res.distances[i]);
+  resp->set_ret_code(200);
+  resp->set_msg("ok");
+  if (!res.filter_plan.empty()) {
+    resp->set_filter_plan(res.filter_plan);
+    CountFilterPlan(res.filter_plan);
+  }
+  if (res.filter_cache_hit.has_value()) {
+    resp->set_filter_cache_hit(*res.filter_cache_hit);
+    CountFilterCache(*res.filter_cache_hit);
+  }
+  size_t num_queries = res.indices.size() / opts.k;
+  for (size_t q = 0; q < num_queries; ++q) {
+    auto* knn = resp->add_results();
+    for (size_t i = q * opts.k; i < (q + 1) * opts.k; ++i) {
+      if (res.indices[i] != -1) {
+        knn->add_indices(res.indices[i]);
+        knn->add_distances(res.distances[i]);
+      }
     }
   }
-  return resp;
-}
-
-ResponseMsg QueryHandler(brpc::Controller* cntl, Database* database) {
-  service::QueryRequest req;
-  service::QueryResponse resp;
-  auto st = JsonStrToPb(cntl->request_attachment().to_string(), &req);
-  if (!st.ok()) {
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to parse http request");
-    return resp;
+  if (num_queries == 1) {
+    *resp->mutable_indices() = resp->results(0).indices();
+    *resp->mutable_distances() = resp->results(0).distances();
   }
+}
 
+void ProcessQuery(Database* database, const service::QueryRequest& req, service::QueryResponse* resp) {
   if (!req.id()) {
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to query, invalid params");
-    return resp;
+    resp->set_ret_code(400);
+    resp->set_msg("Failed to query, invalid params");
+    return;
   }
 
   std::string value;
   if (!database->Query(req.id(), &value)) {
     LOG(WARNING) << "Failed to query.";
-    resp.set_ret_code(400);
-    resp.set_msg("Failed to query");
+    resp->set_ret_code(400);
+    resp->set_msg("Failed to query");
+    return;
   }
 
-  resp.set_ret_code(200);
-  resp.set_msg("ok");
-  resp.mutable_upsert_data()->ParseFromString(value);
+  resp->set_ret_code(200);
+  resp->set_msg("ok");
+  resp->mutable_upsert_data()->ParseFromString(value);
+}
+
+/************************************************************************/
+/* Handlers */
+/************************************************************************/
+struct ResponseMsg {
+  int ret_code = 0;
+  std::string msg;
+
+  ResponseMsg() = default;
+  template <typename Message>
+  // NOLINTNEXTLINE
+  ResponseMsg(const Message& m) : ret_code(m.ret_code()), msg(PbToJsonStr(m)) {}
+};
+
+template <typename Request, typename Response>
+ResponseMsg JsonHandler(brpc::Controller* cntl, Database* database,
+                        void (*process)(Database*, const Request&, Response*)) {
+  Request req;
+  Response resp;
+  auto st = JsonStrToPb(cntl->request_attachment().to_string(), &req);
+  if (!st.ok()) {
+    resp.set_ret_code(400);
+    resp.set_msg("Failed to parse http request");
+    return resp;
+  }
+  process(database, req, &resp);
   return resp;
 }
 
-// TODO(cong): 自动 snapshot
 ResponseMsg Snapshot(Database* database) {
   service::EmptyResponse resp;
   if (!database->SaveSnapshot()) {
-    LOG(WARNING) << "Failed to search.";
+    LOG(WARNING) << "Failed to save snapshot.";
     resp.set_ret_code(400);
-    resp.set_msg("Failed to search");
+    resp.set_msg("Failed to save snapshot");
   } else {
     resp.set_ret_code(200);
     resp.set_msg("ok");
@@ -201,11 +280,13 @@ void VdbServiceImpl::http(google::protobuf::RpcController* cntl_base, const serv
   const std::string& unresolved_path = cntl->http_request().unresolved_path();
   ResponseMsg rm;
   if (unresolved_path == "upsert") {
-    rm = UpsertHandler(cntl, database_);
+    rm = JsonHandler(cntl, database_, ProcessUpsert);
+  } else if (unresolved_path == "upsert_batch") {
+    rm = JsonHandler(cntl, database_, ProcessUpsertBatch);
   } else if (unresolved_path == "search") {
-    rm = SearchHandler(cntl, database_);
+    rm = JsonHandler(cntl, database_, ProcessSearch);
   } else if (unresolved_path == "query") {
-    rm = QueryHandler(cntl, database_);
+    rm = JsonHandler(cntl, database_, ProcessQuery);
   } else if (unresolved_path == "snapshot") {
     rm = Snapshot(database_);
   } else {
@@ -224,4 +305,29 @@ void VdbServiceImpl::http(google::protobuf::RpcController* cntl_base, const serv
             << ",response=" << rm.msg;
 }
 
+void VdbServiceImpl::Upsert(google::protobuf::RpcController* /* cntl_base */, const service::UpsertRequest* request,
+                            service::EmptyResponse* response, google::protobuf::Closure* done) {
+  brpc::ClosureGuard done_guard(done);
+  ProcessUpsert(database_, *request, response);
+}
+
+void VdbServiceImpl::UpsertBatch(google::protobuf::RpcController* /* cntl_base */,
+                                 const service::UpsertBatchRequest* request, service::EmptyResponse* response,
+                                 google::protobuf::Closure* done) {
+  brpc::ClosureGuard done_guard(done);
+  ProcessUpsertBatch(database_, *request, response);
+}
+
+void VdbServiceImpl::Search(google::protobuf::RpcController* /* cntl_base */, const service::SearchRequest* request,
+                            service::SearchResponse* response, google::protobuf::Closure* done) {
+  brpc::ClosureGuard done_guard(done);
+  ProcessSearch(database_, *request, response);
+}
+
+void VdbServiceImpl::Query(google::protobuf::RpcController* /* cntl_base */, const service::QueryRequest* request,
+                           service::QueryResponse* response, google::protobuf::Closure* done) {
+  brpc::ClosureGuard done_guard(done);
+  ProcessQuery(database_, *request, response);
+}
+
 }  // namespace vdb
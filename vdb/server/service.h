@@ -19,6 +19,16 @@ class VdbServiceImpl : public service::VdbService {
  public:
   void http(google::protobuf::RpcController* cntl_base, const service::HttpRequest* request,
             service::HttpResponse* response, google::protobuf::Closure* done) override;
+
+  // 二进制 protobuf 接口，与 `http` 中同名路径的处理逻辑一致
+  void Upsert(google::protobuf::RpcController* cntl_base, const service::UpsertRequest* request,
+              service::EmptyResponse* response, google::protobuf::Closure* done) override;
+  void UpsertBatch(google::protobuf::RpcController* cntl_base, const service::UpsertBatchRequest* request,
+                   service::EmptyResponse* response, google::protobuf::Closure* done) override;
+  void Search(google::protobuf::RpcController* cntl_base, const service::SearchRequest* request,
+              service::SearchResponse* response, google::protobuf::Closure* done) override;
+  void Query(google::protobuf::RpcController* cntl_base, const service::QueryRequest* request,
+             service::QueryResponse* response, google::protobuf::Closure* done) override;
 };
 
 }  // namespace vdb
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <utility>
+
+namespace vdb {
+
+/************************************************************************/
+/* BlockingQueue */
+/************************************************************************/
+// 有界阻塞队列，`Close` 后 `Push` 失败，`Pop` 取完剩余元素后失败
+template <typename T>
+class BlockingQueue {
+ private:
+  size_t capacity_;
+  std::queue<T> queue_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  bool closed_{false};
+
+ public:
+  explicit BlockingQueue(size_t capacity) : capacity_(capacity) {}
+
+ public:
+  [[nodiscard]] bool Push(T value) {
+    std::unique_lock lock(mutex_);
+    not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    queue_.push(std::move(value));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  [[nodiscard]] bool Pop(T* value) {
+    std::unique_lock lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return false;
+    }
+    *value = std::move(queue_.front());
+    queue_.pop();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void Close() {
+    {
+      std::lock_guard lock(mutex_);
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+};
+
+}  // namespace vdb
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <fcntl.h>
 #include <glog/logging.h>
 #include <google/protobuf/stubs/status.h>
 #include <google/protobuf/util/json_util.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <iomanip>
 #include <string>
 
@@ -35,4 +37,15 @@ inline google::protobuf::util::Status JsonStrToPb(const std::string& str, google
   return google::protobuf::util::Status();
 }
 
+// 对文件或目录执行 fsync；目录 fsync 用于持久化其中的创建/rename
+inline bool SyncPath(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = ::fsync(fd) == 0;
+  ::close(fd);
+  return ok;
+}
+
 }  // namespace vdb